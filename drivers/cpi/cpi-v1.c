@@ -109,6 +109,119 @@ void pi_cpi_capture_async(struct pi_device *device, void *buffer, int32_t size,
 
 
 
+static pi_buf_t *__rt_cpi_stream_buf(rt_cpi_t *cpi, void *addr)
+{
+  for (int i=0; i<cpi->stream.nb_buffers; i++)
+  {
+    if (cpi->stream_bufs[i].addr == addr)
+      return &cpi->stream_bufs[i];
+  }
+
+  return NULL;
+}
+
+
+
+// Called when the last reference on a frame is released. The stream gets
+// the frames back in the order they were acquired, so the released frames
+// are given back as long as the oldest acquired one is released.
+static void __rt_cpi_stream_buf_release(pi_buf_t *buf, void *arg)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)arg;
+  rt_udma_stream_t *stream = &cpi->stream;
+
+  while (stream->nb_acquired)
+  {
+    pi_buf_t *first = __rt_cpi_stream_buf(cpi, stream->buffers[stream->first]);
+    if (first->refcount)
+      break;
+
+    // Frames in the stream keep one reference, which is given to the
+    // consumer when they are acquired
+    first->refcount = 1;
+    first->length = first->size;
+    __rt_udma_stream_release(stream);
+  }
+}
+
+
+
+int pi_cpi_stream_start(struct pi_device *device, void **buffers, int nb_buffers, int32_t size)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  int irq = rt_irq_disable();
+
+  if (nb_buffers > RT_UDMA_STREAM_MAX_BUFFERS)
+    goto error;
+
+  for (int i=0; i<nb_buffers; i++)
+  {
+    pi_buf_init(&cpi->stream_bufs[i], buffers[i], size, __rt_cpi_stream_buf_release, (void *)cpi);
+  }
+
+  // Frames are now delivered to the stream instead of the copy queue
+  __rt_udma_register_channel_callback(UDMA_EVENT_ID(cpi->channel_id), __rt_udma_handle_stream, (void *)&cpi->stream);
+
+  if (__rt_udma_stream_start(&cpi->stream, UDMA_CHANNEL_ID(cpi->channel_id), buffers, nb_buffers, size, UDMA_CHANNEL_CFG_SIZE_16))
+    goto error;
+
+  rt_irq_restore(irq);
+  return 0;
+
+error:
+  __rt_udma_register_channel_callback(UDMA_EVENT_ID(cpi->channel_id), __rt_udma_handle_copy, (void *)cpi);
+  rt_irq_restore(irq);
+  return -1;
+}
+
+
+
+void pi_cpi_stream_stop(struct pi_device *device)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  int irq = rt_irq_disable();
+
+  __rt_udma_stream_stop(&cpi->stream);
+  plp_udma_clr(hal_udma_channel_base(UDMA_CHANNEL_ID(cpi->channel_id)));
+  __rt_udma_stream_flush(&cpi->stream);
+
+  __rt_udma_register_channel_callback(UDMA_EVENT_ID(cpi->channel_id), __rt_udma_handle_copy, (void *)cpi);
+
+  rt_irq_restore(irq);
+}
+
+
+
+void pi_cpi_stream_acquire_async(struct pi_device *device, pi_task_t *task)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  __rt_task_init(task);
+  __rt_udma_stream_acquire(&cpi->stream, task);
+}
+
+
+
+void pi_cpi_stream_release(struct pi_device *device)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  __rt_udma_stream_release(&cpi->stream);
+}
+
+
+
+pi_buf_t *pi_cpi_stream_buf_status(struct pi_device *device, pi_task_t *task)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  void *addr = pi_cpi_stream_status(task);
+
+  if (addr == NULL)
+    return NULL;
+
+  return __rt_cpi_stream_buf(cpi, addr);
+}
+
+
+
 static void __attribute__((constructor)) __rt_cpi_init()
 {
   for (int i=0; i<ARCHI_UDMA_NB_CAM; i++)
@@ -17,7 +17,7 @@ endif
 
 ifneq '$(udma/version)' ''
 PULP_CFLAGS += -D__RT_UDMA_COPY_ASM=1
-PULP_LIB_FC_SRCS_rt     += drivers/udma/udma-v$(udma/archi).c
+PULP_LIB_FC_SRCS_rt     += drivers/udma/udma-v$(udma/archi).c drivers/udma/udma_stream.c
 PULP_LIB_FC_ASM_SRCS_rt += drivers/udma/udma-v$(udma/archi)_asm.S
 endif
 
@@ -27,7 +27,7 @@ endif
 ifeq '$(CONFIG_HYPER_ENABLED)' '1'
 ifneq '$(udma/hyper/version)' ''
 PULP_CFLAGS += -D__RT_HYPER_COPY_ASM=1
-PULP_LIB_FC_SRCS_rt += drivers/hyper/hyperram-v$(udma/hyper/version).c
+PULP_LIB_FC_SRCS_rt += drivers/hyper/hyperram-v$(udma/hyper/version).c drivers/hyper/hyper_cache.c
 PULP_LIB_FC_ASM_SRCS_rt += drivers/hyper/hyperram-v$(udma/hyper/version)_asm.S
 endif
 endif
@@ -59,7 +59,6 @@ ifeq '$(CONFIG_I2S_ENABLED)' '1'
 ifneq '$(udma/i2s/version)' ''
 ifeq '$(udma/i2s/version)' '1'
 PULP_LIB_FC_SRCS_rt += drivers/i2s/i2s-v$(udma/i2s/version).c
-PULP_LIB_FC_ASM_SRCS_rt +=  drivers/i2s/i2s-v$(udma/i2s/version)_asm.S
 endif
 endif
 endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+
+// Operation stored in data[0] of the requests
+#define __PI_HYPER_CACHE_READ   0
+#define __PI_HYPER_CACHE_WRITE  1
+#define __PI_HYPER_CACHE_FLUSH  2
+
+#define __PI_HYPER_CACHE_INVALID 0xffffffff
+
+static void __pi_hyper_cache_exec(pi_hyper_cache_t *cache);
+
+
+
+static inline char *__pi_hyper_cache_page_data(pi_hyper_cache_t *cache, pi_hyper_cache_page_t *page)
+{
+  return cache->data + (page - cache->pages) * cache->page_size;
+}
+
+
+
+// Called when a page transfer with the HyperRAM is over, to continue the
+// current request
+static void __pi_hyper_cache_resume(void *arg)
+{
+  pi_hyper_cache_t *cache = (pi_hyper_cache_t *)arg;
+  int irq = rt_irq_disable();
+  __pi_hyper_cache_exec(cache);
+  rt_irq_restore(irq);
+}
+
+
+
+static pi_hyper_cache_page_t *__pi_hyper_cache_lookup(pi_hyper_cache_t *cache, uint32_t tag)
+{
+  for (int i=0; i<cache->nb_pages; i++)
+  {
+    if (cache->pages[i].tag == tag)
+      return &cache->pages[i];
+  }
+  return NULL;
+}
+
+
+
+static pi_hyper_cache_page_t *__pi_hyper_cache_victim(pi_hyper_cache_t *cache)
+{
+  pi_hyper_cache_page_t *victim = &cache->pages[0];
+
+  for (int i=0; i<cache->nb_pages; i++)
+  {
+    pi_hyper_cache_page_t *page = &cache->pages[i];
+    if (page->tag == __PI_HYPER_CACHE_INVALID)
+      return page;
+    if ((int)(page->last_use - victim->last_use) < 0)
+      victim = page;
+  }
+
+  return victim;
+}
+
+
+
+// Writes back a modified page. Returns 1 if a transfer was started, in which
+// case the request continues when it is over.
+static int __pi_hyper_cache_write_back(pi_hyper_cache_t *cache, pi_hyper_cache_page_t *page)
+{
+  if (!page->dirty)
+    return 0;
+
+  page->dirty = 0;
+  pi_task_callback(&cache->task, __pi_hyper_cache_resume, (void *)cache);
+  pi_hyper_write_async(cache->device, page->tag, __pi_hyper_cache_page_data(cache, page), cache->page_size, &cache->task);
+
+  return 1;
+}
+
+
+
+// Executes the current request as far as possible. Returns 0 if it is over,
+// or 1 if it is waiting for a page transfer.
+static int __pi_hyper_cache_exec_req(pi_hyper_cache_t *cache, pi_task_t *task)
+{
+  int op = task->implem.data[0];
+
+  if (op == __PI_HYPER_CACHE_FLUSH)
+  {
+    for (int i=0; i<cache->nb_pages; i++)
+    {
+      if (__pi_hyper_cache_write_back(cache, &cache->pages[i]))
+        return 1;
+    }
+    return 0;
+  }
+
+  while (task->implem.data[3] > 0)
+  {
+    uint32_t hyper_addr = task->implem.data[1];
+    char *addr = (char *)task->implem.data[2];
+    uint32_t size = task->implem.data[3];
+    uint32_t tag = hyper_addr & ~(cache->page_size - 1);
+    uint32_t offset = hyper_addr - tag;
+    uint32_t iter_size = cache->page_size - offset;
+    if (iter_size > size)
+      iter_size = size;
+
+    pi_hyper_cache_page_t *page = __pi_hyper_cache_lookup(cache, tag);
+
+    if (page == NULL)
+    {
+      // Only count the first miss, the lookup is done again once the page
+      // is there.
+      if (!cache->missed)
+      {
+        cache->missed = 1;
+        cache->misses++;
+      }
+
+      page = __pi_hyper_cache_victim(cache);
+
+      if (__pi_hyper_cache_write_back(cache, page))
+        return 1;
+
+      page->tag = tag;
+      page->last_use = cache->tick++;
+
+      // A write covering the whole page does not need its previous content
+      if (op != __PI_HYPER_CACHE_WRITE || iter_size != cache->page_size)
+      {
+        pi_task_callback(&cache->task, __pi_hyper_cache_resume, (void *)cache);
+        pi_hyper_read_async(cache->device, tag, __pi_hyper_cache_page_data(cache, page), cache->page_size, &cache->task);
+        return 1;
+      }
+    }
+    else
+    {
+      if (!cache->missed)
+        cache->hits++;
+
+      page->last_use = cache->tick++;
+    }
+
+    char *data = __pi_hyper_cache_page_data(cache, page) + offset;
+
+    if (op == __PI_HYPER_CACHE_READ)
+    {
+      __rt_memcpy_fast(addr, data, iter_size);
+    }
+    else
+    {
+      __rt_memcpy_fast(data, addr, iter_size);
+      page->dirty = 1;
+    }
+
+    cache->missed = 0;
+    task->implem.data[1] = hyper_addr + iter_size;
+    task->implem.data[2] = (uint32_t)addr + iter_size;
+    task->implem.data[3] = size - iter_size;
+  }
+
+  return 0;
+}
+
+
+
+static void __pi_hyper_cache_exec(pi_hyper_cache_t *cache)
+{
+  while (1)
+  {
+    pi_task_t *task = cache->current;
+
+    if (task == NULL)
+    {
+      task = cache->first;
+      if (task == NULL)
+        return;
+
+      cache->first = task->implem.next;
+      cache->current = task;
+    }
+
+    if (__pi_hyper_cache_exec_req(cache, task))
+      return;
+
+    cache->current = NULL;
+    __rt_event_handle_end_of_task(task);
+  }
+}
+
+
+
+static void __pi_hyper_cache_enqueue(pi_hyper_cache_t *cache, int op, uint32_t hyper_addr, void *addr, uint32_t size, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  task->implem.data[0] = op;
+  task->implem.data[1] = hyper_addr;
+  task->implem.data[2] = (uint32_t)addr;
+  task->implem.data[3] = size;
+
+  if (cache->first)
+    cache->last->implem.next = task;
+  else
+    cache->first = task;
+  cache->last = task;
+  task->implem.next = NULL;
+
+  // Otherwise the request is executed when the current one is over
+  if (cache->current == NULL)
+    __pi_hyper_cache_exec(cache);
+
+  rt_irq_restore(irq);
+}
+
+
+
+int pi_hyper_cache_init(pi_hyper_cache_t *cache, struct pi_device *device, int nb_pages, uint32_t page_size)
+{
+  if (page_size == 0 || (page_size & (page_size - 1)))
+    goto error;
+
+  cache->pages = pmsis_l2_malloc(sizeof(pi_hyper_cache_page_t) * nb_pages);
+  if (cache->pages == NULL)
+    goto error;
+
+  cache->data = pmsis_l2_malloc(page_size * nb_pages);
+  if (cache->data == NULL)
+    goto error_data;
+
+  cache->device = device;
+  cache->page_size = page_size;
+  cache->nb_pages = nb_pages;
+  cache->tick = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->missed = 0;
+  cache->current = NULL;
+  cache->first = NULL;
+
+  for (int i=0; i<nb_pages; i++)
+  {
+    cache->pages[i].tag = __PI_HYPER_CACHE_INVALID;
+    cache->pages[i].dirty = 0;
+    cache->pages[i].last_use = 0;
+  }
+
+  return 0;
+
+error_data:
+  pmsis_l2_malloc_free(cache->pages, sizeof(pi_hyper_cache_page_t) * nb_pages);
+error:
+  return -1;
+}
+
+
+
+void pi_hyper_cache_deinit(pi_hyper_cache_t *cache)
+{
+  pmsis_l2_malloc_free(cache->data, cache->page_size * cache->nb_pages);
+  pmsis_l2_malloc_free(cache->pages, sizeof(pi_hyper_cache_page_t) * cache->nb_pages);
+}
+
+
+
+void pi_hyper_cache_read_async(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size, pi_task_t *task)
+{
+  __rt_task_init(task);
+  __pi_hyper_cache_enqueue(cache, __PI_HYPER_CACHE_READ, hyper_addr, addr, size, task);
+}
+
+
+
+void pi_hyper_cache_write_async(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size, pi_task_t *task)
+{
+  __rt_task_init(task);
+  __pi_hyper_cache_enqueue(cache, __PI_HYPER_CACHE_WRITE, hyper_addr, addr, size, task);
+}
+
+
+
+void pi_hyper_cache_flush_async(pi_hyper_cache_t *cache, pi_task_t *task)
+{
+  __rt_task_init(task);
+  __pi_hyper_cache_enqueue(cache, __PI_HYPER_CACHE_FLUSH, 0, NULL, 0, task);
+}
+
+
+
+void pi_hyper_cache_read(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size)
+{
+  pi_task_t task;
+  pi_hyper_cache_read_async(cache, hyper_addr, addr, size, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
+void pi_hyper_cache_write(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size)
+{
+  pi_task_t task;
+  pi_hyper_cache_write_async(cache, hyper_addr, addr, size, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
+void pi_hyper_cache_flush(pi_hyper_cache_t *cache)
+{
+  pi_task_t task;
+  pi_hyper_cache_flush_async(cache, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
+void pi_hyper_cache_stats_get(pi_hyper_cache_t *cache, uint32_t *hits, uint32_t *misses)
+{
+  *hits = cache->hits;
+  *misses = cache->misses;
+}
@@ -71,6 +71,7 @@ typedef struct {
   int channel;
   int cs;
   int type;
+  pi_hyper_cache_t *cache;
 } pi_hyper_t;
 
 
@@ -244,6 +245,7 @@ int32_t pi_hyper_open(struct pi_device *device)
   hyper->channel = periph_id;
   hyper->cs = conf->cs;
   hyper->type = conf->type;
+  hyper->cache = NULL;
 
   __rt_hyper_open_count++;
   if (__rt_hyper_open_count == 1)
@@ -414,6 +416,14 @@ void pi_hyper_write_2d(struct pi_device *device,
 
 
 
+void pi_hyper_cache_attach(struct pi_device *device, pi_hyper_cache_t *cache)
+{
+  pi_hyper_t *hyper = (pi_hyper_t *)device->data;
+  hyper->cache = cache;
+}
+
+
+
 static int __pi_hyper_init(pi_hyper_t *hyper, int ramsize)
 {
   if (rt_extern_alloc_init(&hyper->alloc, 0, ramsize))
@@ -850,20 +860,13 @@ static void exec_pending_task()
 
 
 
-// TODO this should be done using UDMA
+// The copies done here are limited to the temporary buffer and are needed
+// before the next step of the state machine, so they are done synchronously
+// with the fast copy of the FC copy service.
 static inline void *l2_memcpy(void *dst0, const void *src0, size_t len0)
 {
-  char *dst = (char *) dst0;
-  char *src = (char *) src0;
-
-  void *save = dst0;
-
-  while (len0--)
-    {
-      *dst++ = *src++;
-    }
-
-  return save;
+  __rt_memcpy_fast(dst0, src0, len0);
+  return dst0;
 }
 
 
@@ -975,7 +978,14 @@ static void __pi_hyper_cluster_req_exec(pi_cl_hyper_req_t *req)
   pi_task_t *event = &__pi_hyper_cluster_task;
   pi_task_callback(event, __pi_hyper_cluster_req_done, (void* )req);
 
-  if(req->is_2d)
+  if (hyper->cache && !req->is_2d)
+  {
+    if (req->is_write)
+      pi_hyper_cache_write_async(hyper->cache, req->hyper_addr, req->addr, req->size, event);
+    else
+      pi_hyper_cache_read_async(hyper->cache, req->hyper_addr, req->addr, req->size, event);
+  }
+  else if(req->is_2d)
     __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, req->stride, req->length, event, hyper->cs);
   else
     __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, event, hyper->cs);
@@ -38,19 +38,21 @@ RT_FC_TINY_DATA unsigned int __rt_hyper_pending_repeat_size;
 // as a transfer was already on-going.
 RT_FC_TINY_DATA struct pi_task *__rt_hyper_pending_tasks;
 RT_FC_TINY_DATA struct pi_task *__rt_hyper_pending_tasks_last;
-
-// All the following are used to keep track of the current transfer when it is
-// emulated due to aligment constraints.
+// Last high-priority task of the pending queue. High-priority tasks are
+// inserted after this one, in front of all normal tasks.
+static struct pi_task *__rt_hyper_pending_tasks_prio_last;
+
+// Adjacent 1D requests of the pending queue are merged into a single
+// transfer. The merged tasks are kept here and notified by this local task
+// when the transfer is over.
+static struct pi_task __rt_hyper_merge_task;
+static struct pi_task *__rt_hyper_merge_first;
+static int __rt_hyper_merge_busy;
+
+// Task of the current transfer when it is emulated due to aligment constraints.
 // The interrupt handler executed at end of transfer will execute the FSM to reenqueue
-// a partial transfer.
-RT_FC_TINY_DATA int __rt_hyper_pending_emu_channel;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_hyper_addr;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_addr;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_size;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_size_2d;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_length;
-RT_FC_TINY_DATA unsigned int __rt_hyper_pending_emu_stride;
-RT_FC_TINY_DATA unsigned char __rt_hyper_pending_emu_do_memcpy;
+// a partial transfer. The state of the emulation is kept in the task itself
+// so that each request has its own context.
 RT_FC_TINY_DATA struct pi_task *__rt_hyper_pending_emu_task;
 
 // Local task used to enqueue cluster requests.
@@ -63,12 +65,44 @@ static pi_cl_hyper_req_t *__pi_hyper_cluster_reqs_last;
 static int __rt_hyper_open_count;
 
 
+// State of an emulated transfer, stored in the data of the task. It is
+// bigger than the data array, which is fine as it shares the task union
+// with the periph copy structure.
+typedef struct {
+  uint8_t channel;
+  uint8_t step;
+  uint32_t hyper_addr;
+  uint32_t addr;
+  uint32_t size;
+  uint32_t size_2d;
+  uint32_t length;
+  uint32_t stride;
+  uint32_t count;
+  uint32_t plane_hyper_addr;
+  uint32_t plane_size;
+  uint32_t plane_stride;
+  uint32_t plane_remaining;
+} pi_hyper_emu_t;
+
+// Steps of the emulation, telling what must be done when the current partial
+// transfer is over
+typedef enum {
+  __PI_HYPER_EMU_START,     // Nothing on-going
+  __PI_HYPER_EMU_DIRECT,    // Data transferred in place
+  __PI_HYPER_EMU_BOUNCE,    // Data read into the temporary buffer
+  __PI_HYPER_EMU_SHIFT,     // Data read in place one byte too early
+  __PI_HYPER_EMU_RMW        // Hyper content read into the temporary buffer before a write
+} __pi_hyper_emu_step_e;
+
+
+
 // Hyper structure allocated when opening the driver
 typedef struct {
   rt_extern_alloc_t alloc;
   int channel;
   int cs;
   int type;
+  pi_hyper_cache_t *cache;
 } pi_hyper_t;
 
 
@@ -80,7 +114,8 @@ static int __pi_hyper_init(pi_hyper_t *hyper, int ramsize);
 static void __pi_hyper_free(pi_hyper_t *hyper);
 
 // Performs a direct aligned copy:
-//  - hyper addr is multiple of 2
+//  - hyper addr is multiple of 2, and multiple of 4 if the chip has pages and
+//    the copy crosses a burst boundary
 //  - l2 addr is multiple of 4
 //  - size is multiple of 4
 void __attribute__((noinline)) __pi_hyper_copy_aligned(int channel,
@@ -113,7 +148,7 @@ static void __pi_hyper_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr
 
 // Execute a 2D copy.
 // Contrary to 1D copies, 2D copies are always handled with partial copies
-static void __pi_hyper_2d_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, uint32_t length, pi_task_t *event);
+static void __pi_hyper_2d_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *event);
 
 // CHeck if there is a task waiting for execute it and if so, remove it from the queue
 // and execute it
@@ -122,11 +157,14 @@ static void exec_pending_task();
 // Try to trigger a copy. If there is already one pending, the copy is put on hold,
 // otherwise it is execute.
 static void __pi_hyper_copy(int channel,
-  uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event, int cs);
+  uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event, int cs, int prio);
 
 // Try to trigger a 2d copy. If there is already one pending, the copy is put on hold,
 // otherwise it is execute.
-static void __pi_hyper_copy_2d(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, int length, pi_task_t *event, int cs);
+static void __pi_hyper_copy_2d(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, int length, pi_task_t *event, int cs, int prio);
+
+// Enqueue a 3D copy, made of planes of 2D copies, from fabric controller side
+static void __pi_hyper_copy_3d(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *event, int cs);
 
 // This is called by the interrupt handler when a transfer is finished and a pending
 // misaligned transfer is detected, to continue it.
@@ -153,9 +191,36 @@ static inline void *l2_memcpy(void *dst0, const void *src0, size_t len0);
 
 #define __PI_HYPER_TEMP_BUFFER_SIZE 128
 
+// Flags stored with the channel in data[0] of the pending tasks
+#define __PI_HYPER_PENDING_2D   (1<<8)
+#define __PI_HYPER_PENDING_3D   (1<<9)
+#define __PI_HYPER_PENDING_PRIO (1<<16)
+
 // Temporary buffer of size __PI_HYPER_TEMP_BUFFER_SIZE used for misaligned
 // transfers between hyper and L2
-static char __pi_hyper_temp_buffer[__PI_HYPER_TEMP_BUFFER_SIZE];
+static char __pi_hyper_temp_buffer[__PI_HYPER_TEMP_BUFFER_SIZE] __attribute__((aligned(4)));
+
+// Biggest part of a line which can go through the temporary buffer in one
+// transfer, including the byte needed to align the hyper address.
+#define __PI_HYPER_BOUNCE_MAX (__PI_HYPER_TEMP_BUFFER_SIZE - 4)
+
+// Size of the bursts used to split the transfers, for each chip select.
+// Bursts are aligned on this size so that they never cross a page boundary.
+static uint32_t __pi_hyper_burst_size[2] = { 512, 512 };
+
+// Page size of each chip select, or 0 if bursts can cross any boundary
+static uint32_t __pi_hyper_page_size[2] = { 0, 0 };
+
+// Tells if a transfer can be pushed directly for this hyper address. When the
+// hyper address is not aligned on 4 bytes and the chip has pages, the L2
+// address of the bursts following a page boundary can not be aligned, so the
+// transfer must then stay in one burst.
+static inline int __pi_hyper_direct_ok(uint32_t hyper_addr, uint32_t size)
+{
+  int cs = (hyper_addr & REG_MBR1) != 0;
+  uint32_t burst = __pi_hyper_burst_size[cs];
+  return (hyper_addr & 1) == 0 && ((hyper_addr & 2) == 0 || __pi_hyper_page_size[cs] == 0 || (hyper_addr & (burst - 1)) + size <= burst);
+}
 
 
 
@@ -266,6 +331,7 @@ int32_t pi_hyper_open(struct pi_device *device)
   hyper->channel = periph_id;
   hyper->cs = conf->cs;
   hyper->type = conf->type;
+  hyper->cache = NULL;
 
   __rt_hyper_open_count++;
   if (__rt_hyper_open_count == 1)
@@ -358,7 +424,7 @@ void pi_hyper_read_async(struct pi_device *device,
 {
   pi_hyper_t *hyper = (pi_hyper_t *)device->data;
   __rt_task_init(task);
-  __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + 0, (uint32_t)addr, hyper_addr, size, task, hyper->cs);
+  __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + 0, (uint32_t)addr, hyper_addr, size, task, hyper->cs, 0);
 }
 
 
@@ -379,7 +445,7 @@ void pi_hyper_write_async(struct pi_device *device,
   pi_hyper_t *hyper = (pi_hyper_t *)device->data;
   __rt_task_init(task);
   task->done = 0;
-  __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + 1, (uint32_t)addr, hyper_addr, size, task, hyper->cs);
+  __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + 1, (uint32_t)addr, hyper_addr, size, task, hyper->cs, 0);
 }
 
 
@@ -398,7 +464,7 @@ void pi_hyper_read_2d_async(struct pi_device *device,
 {
   pi_hyper_t *hyper = (pi_hyper_t *)device->data;
   __rt_task_init(task);
-  __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + 0, (uint32_t)addr, hyper_addr, size, stride, length, task, hyper->cs);
+  __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + 0, (uint32_t)addr, hyper_addr, size, stride, length, task, hyper->cs, 0);
 }
 
 
@@ -418,7 +484,7 @@ void pi_hyper_write_2d_async(struct pi_device *device,
 {
   pi_hyper_t *hyper = (pi_hyper_t *)device->data;
   __rt_task_init(task);
-  __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + 1, (uint32_t)addr, hyper_addr, size, stride, length, task, hyper->cs);
+  __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + 1, (uint32_t)addr, hyper_addr, size, stride, length, task, hyper->cs, 0);
 }
 
 
@@ -433,6 +499,73 @@ void pi_hyper_write_2d(struct pi_device *device,
 
 
 
+void pi_hyper_read_3d_async(struct pi_device *device,
+  uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, struct pi_task *task)
+{
+  pi_hyper_t *hyper = (pi_hyper_t *)device->data;
+  __rt_task_init(task);
+  __pi_hyper_copy_3d(UDMA_CHANNEL_ID(hyper->channel) + 0, (uint32_t)addr, hyper_addr, size, stride, length, stride_3d, length_3d, task, hyper->cs);
+}
+
+
+
+void pi_hyper_read_3d(struct pi_device *device,
+  uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d)
+{
+  struct pi_task task;
+  pi_hyper_read_3d_async(device, hyper_addr, addr, size, stride, length, stride_3d, length_3d, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
+void pi_hyper_write_3d_async(struct pi_device *device,
+  uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, struct pi_task *task)
+{
+  pi_hyper_t *hyper = (pi_hyper_t *)device->data;
+  __rt_task_init(task);
+  __pi_hyper_copy_3d(UDMA_CHANNEL_ID(hyper->channel) + 1, (uint32_t)addr, hyper_addr, size, stride, length, stride_3d, length_3d, task, hyper->cs);
+}
+
+
+
+void pi_hyper_write_3d(struct pi_device *device,
+  uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d)
+{
+  struct pi_task task;
+  pi_hyper_write_3d_async(device, hyper_addr, addr, size, stride, length, stride_3d, length_3d, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
+int pi_hyper_burst_conf(struct pi_device *device, uint32_t page_size, uint32_t max_burst)
+{
+  pi_hyper_t *hyper = (pi_hyper_t *)device->data;
+  uint32_t burst = max_burst;
+
+  if (page_size && page_size < burst)
+    burst = page_size;
+
+  if (burst < 4 || (burst & (burst - 1)) || (page_size & (page_size - 1)))
+    return -1;
+
+  __pi_hyper_burst_size[hyper->cs != 0] = burst;
+  __pi_hyper_page_size[hyper->cs != 0] = page_size;
+
+  return 0;
+}
+
+
+
+void pi_hyper_cache_attach(struct pi_device *device, pi_hyper_cache_t *cache)
+{
+  pi_hyper_t *hyper = (pi_hyper_t *)device->data;
+  hyper->cache = cache;
+}
+
+
+
 static int __pi_hyper_init(pi_hyper_t *hyper, int ramsize)
 {
   if (rt_extern_alloc_init(&hyper->alloc, 0, ramsize))
@@ -457,16 +590,29 @@ void __attribute__((noinline)) __pi_hyper_copy_aligned(int channel,
   uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event)
 {
   unsigned int base = hal_udma_channel_base(channel);
+  uint32_t burst = __pi_hyper_burst_size[(hyper_addr & REG_MBR1) != 0];
+  uint32_t first = burst - (hyper_addr & (burst - 1));
+
+  // Without pages, the bursts do not need to stop on a boundary, and a full
+  // first burst keeps the L2 address of the next ones aligned
+  if (first & 3)
+    first = burst;
 
   // In case the size is bigger than the maximum burst size
-  // split the transfer into smaller transfers using the repeat count
-  if (size > 512) {
+  // split the transfer into smaller transfers using the repeat count.
+  // The first burst stops at the next page boundary so that the next ones
+  // are aligned. When the chip has pages, the callers only give a hyper
+  // address which is not aligned on 4 bytes for transfers staying in one
+  // burst, so that the first burst is never made full in this case. As the
+  // end handler adds the repeat size to the pending addresses before each
+  // burst, they are set as if the first burst was a full one.
+  if (size > first) {
     __rt_hyper_pending_base = base;
-    __rt_hyper_pending_hyper_addr = hyper_addr;
-    __rt_hyper_pending_addr = (unsigned int)addr;
-    __rt_hyper_pending_repeat = 512;
-    __rt_hyper_pending_repeat_size = size;
-    size = 512;
+    __rt_hyper_pending_hyper_addr = hyper_addr + first - burst;
+    __rt_hyper_pending_addr = (unsigned int)addr + first - burst;
+    __rt_hyper_pending_repeat = burst;
+    __rt_hyper_pending_repeat_size = size - first + burst;
+    size = first;
   } else {
     __rt_hyper_pending_repeat = 0;
   }
@@ -478,302 +624,258 @@ void __attribute__((noinline)) __pi_hyper_copy_aligned(int channel,
 
 
 
-static int __pi_hyper_resume_misaligned_read(struct pi_task *task)
+static inline pi_hyper_emu_t *__pi_hyper_emu_get(struct pi_task *task)
 {
-  while (1)
-  {
-    // Compute information to see how to do one more step
-    int addr_aligned = (__rt_hyper_pending_emu_addr + 3) & ~0x3;
-    int prologue_size = addr_aligned - (int)__rt_hyper_pending_emu_addr;
-    int hyper_addr_aligned = __rt_hyper_pending_emu_hyper_addr + prologue_size;
+  return (pi_hyper_emu_t *)task->implem.data;
+}
 
-    if (__rt_hyper_pending_emu_size < 4)
-      prologue_size = __rt_hyper_pending_emu_size;
 
-    if (prologue_size)
-    {
-      // Case where we have a partial copy to do
-      if (!__rt_hyper_pending_emu_do_memcpy)
-      {
-        // A partial transfer must first transfer to the temporary area
-        // and finish the transfer by hands using a memcpy.
-        // This part is first called to trigger the transfer while the part after
-        // is called to do the memcpy as a second step.
-        __pi_hyper_copy_aligned(
-          __rt_hyper_pending_emu_channel,
-          (uint32_t)__pi_hyper_temp_buffer,
-          (__rt_hyper_pending_emu_hyper_addr & ~1),
-          4,
-          NULL
-        );
-
-        // It is asynchronous, just remember we have to do
-        // a memcpy when the transfer is done and leave
-        __rt_hyper_pending_emu_do_memcpy = 1;
-        return 0;
-      }
 
-      __rt_hyper_pending_emu_do_memcpy = 0;
-      l2_memcpy((void *)__rt_hyper_pending_emu_addr, &__pi_hyper_temp_buffer[__rt_hyper_pending_emu_hyper_addr & 1], prologue_size);
+static inline void __pi_hyper_emu_advance(pi_hyper_emu_t *emu, uint32_t count)
+{
+  emu->hyper_addr += count;
+  emu->addr += count;
+  emu->size -= count;
+}
 
-      __rt_hyper_pending_emu_hyper_addr += prologue_size;
-      __rt_hyper_pending_emu_addr += prologue_size;
-      __rt_hyper_pending_emu_size -= prologue_size;
 
-      // The transfer is asynchronous, we get there to do the memcpy
-      // without triggering any transfer, so we can start again to trigger one.
-      if (__rt_hyper_pending_emu_size)
-        continue;
 
-    }
-    else if (__rt_hyper_pending_emu_size > 0)
-    {
-      // Case where we have the body to transfer
-      uint32_t size_aligned = __rt_hyper_pending_emu_size & ~0x3;
+// Called when a line is done, returns 1 if there is another line to transfer
+static int __pi_hyper_emu_next_line(pi_hyper_emu_t *emu)
+{
+  if (emu->size_2d == 0)
+    return 0;
 
-      if ((hyper_addr_aligned & 0x1) == 0)
-      {
-        // Good case where the body is aligned on both sides and we can do
-        // a direct copy.
-        __pi_hyper_copy_aligned(
-          __rt_hyper_pending_emu_channel,
-          __rt_hyper_pending_emu_addr,
-          __rt_hyper_pending_emu_hyper_addr,
-          size_aligned,
-          NULL
-        );
-
-        __rt_hyper_pending_emu_hyper_addr += size_aligned;
-        __rt_hyper_pending_emu_addr += size_aligned;
-        __rt_hyper_pending_emu_size -= size_aligned;
-
-        // It is asynchronous, just leave, we'll continue the transfer
-        // when this one is over
-        return 0;
-      }
-      else
-      {
-        // Bad case where we have to transfer the body using a temporary
-        // buffer as the aligments on both sides are not compatible.
-        // This part is very similar to the prologue.
-        // Just be careful to split into small transfers to fit the temporary buffer.
+  // Update the global size
+  if (emu->size_2d > emu->length)
+    emu->size_2d -= emu->length;
+  else
+    emu->size_2d = 0;
 
-        if (size_aligned > __PI_HYPER_TEMP_BUFFER_SIZE - 4)
-          size_aligned = __PI_HYPER_TEMP_BUFFER_SIZE - 4;
+  // And check if we must reenqueue a line.
+  if (emu->size_2d == 0)
+    return 0;
 
-        if (!__rt_hyper_pending_emu_do_memcpy)
-        {
-          __pi_hyper_copy_aligned(
-            __rt_hyper_pending_emu_channel,
-            (uint32_t)__pi_hyper_temp_buffer,
-            (__rt_hyper_pending_emu_hyper_addr & ~1),
-            size_aligned+4,
-            NULL
-          );
-
-          __rt_hyper_pending_emu_do_memcpy = 1;
-          return 0;
-        }
+  // For 3D transfers, jump to the next plane once all its lines are done
+  if (emu->plane_size)
+  {
+    emu->plane_remaining -= emu->length;
+    if (emu->plane_remaining == 0)
+    {
+      emu->plane_hyper_addr += emu->plane_stride;
+      emu->plane_remaining = emu->plane_size;
+      emu->hyper_addr = emu->plane_hyper_addr;
+      emu->size = emu->size_2d > emu->length ? emu->length : emu->size_2d;
+      return 1;
+    }
+  }
 
-        __rt_hyper_pending_emu_do_memcpy = 0;
-        l2_memcpy((void *)__rt_hyper_pending_emu_addr, &__pi_hyper_temp_buffer[1], size_aligned);
+  emu->hyper_addr = emu->hyper_addr - emu->length + emu->stride;
+  emu->size = emu->size_2d > emu->length ? emu->length : emu->size_2d;
 
-        __rt_hyper_pending_emu_hyper_addr += size_aligned;
-        __rt_hyper_pending_emu_addr += size_aligned;
-        __rt_hyper_pending_emu_size -= size_aligned;
+  return 1;
+}
 
-        if (__rt_hyper_pending_emu_size)
-          continue;
-      }
-    }
 
-    // Now check if we are done
-    if (__rt_hyper_pending_emu_size == 0)
-    {
-      // Check if we are doing a 2D transfer
-      if (__rt_hyper_pending_emu_size_2d > 0)
-      {
-        // In this case, update the global size
-        if (__rt_hyper_pending_emu_size_2d > __rt_hyper_pending_emu_length)
-          __rt_hyper_pending_emu_size_2d -= __rt_hyper_pending_emu_length;
-        else
-          __rt_hyper_pending_emu_size_2d = 0;
-
-        // And check if we must reenqueue a line.
-        if (__rt_hyper_pending_emu_size_2d > 0)
-        {
-          __rt_hyper_pending_emu_hyper_addr = __rt_hyper_pending_emu_hyper_addr - __rt_hyper_pending_emu_length + __rt_hyper_pending_emu_stride;
-          __rt_hyper_pending_emu_size = __rt_hyper_pending_emu_size_2d > __rt_hyper_pending_emu_length ? __rt_hyper_pending_emu_length : __rt_hyper_pending_emu_size_2d;
-          continue;
-        }
-      }
 
-      __rt_hyper_pending_emu_task = NULL;
-      __rt_hyper_current_task = NULL;
-      __rt_event_handle_end_of_task(task);
+// Moves all bytes of an aligned buffer from 1 to 3 bytes down, a word at a
+// time.
+static void __pi_hyper_shift_left(uint32_t *buffer, uint32_t size, uint32_t shift)
+{
+  uint32_t nb_words = size >> 2;
+  uint32_t current = buffer[0];
 
-      return 1;
-    }
-    break;
+  for (uint32_t i=0; i<nb_words-1; i++)
+  {
+    uint32_t next = buffer[i+1];
+    buffer[i] = (current >> (shift * 8)) | (next << (32 - shift * 8));
+    current = next;
   }
 
-  return 0;
+  buffer[nb_words-1] = current >> (shift * 8);
 }
 
 
 
-static int __pi_hyper_resume_misaligned_write(struct pi_task *task)
+// Starts the next partial read of the current line. At most 3 transfers are
+// needed for a line: the misaligned head through the temporary buffer, the
+// body in one burst and the tail through the temporary buffer. Short lines
+// go through the temporary buffer in one transfer.
+// Transfers through the temporary buffer start on a hyper address aligned on
+// 4 bytes so that they can be split on page boundaries.
+static void __pi_hyper_emu_read_step(pi_hyper_emu_t *emu)
 {
+  uint32_t addr = emu->addr;
+  uint32_t hyper_addr = emu->hyper_addr;
+  uint32_t size = emu->size;
+  uint32_t head = (-addr) & 3;
 
-  while(1)
+  if ((head | (size & 3)) == 0 && __pi_hyper_direct_ok(hyper_addr, size))
+  {
+    emu->step = __PI_HYPER_EMU_DIRECT;
+    emu->count = size;
+    __pi_hyper_copy_aligned(emu->channel, addr, hyper_addr, size, NULL);
+  }
+  else if (size <= __PI_HYPER_BOUNCE_MAX || head)
   {
-    // Compute information to see how to do one more step
-    int addr_aligned = (__rt_hyper_pending_emu_addr + 3) & ~0x3;
-    int prologue_size = addr_aligned - __rt_hyper_pending_emu_addr;
-    int hyper_addr_aligned = __rt_hyper_pending_emu_hyper_addr + prologue_size;
+    uint32_t count = size <= __PI_HYPER_BOUNCE_MAX ? size : head;
+    emu->step = __PI_HYPER_EMU_BOUNCE;
+    emu->count = count;
+    __pi_hyper_copy_aligned(emu->channel, (uint32_t)__pi_hyper_temp_buffer, hyper_addr & ~3, (count + (hyper_addr & 3) + 3) & ~3, NULL);
+  }
+  else if (__pi_hyper_direct_ok(hyper_addr, size & ~3))
+  {
+    emu->step = __PI_HYPER_EMU_DIRECT;
+    emu->count = size & ~3;
+    __pi_hyper_copy_aligned(emu->channel, addr, hyper_addr, size & ~3, NULL);
+  }
+  else
+  {
+    // The L2 and hyper alignments are not compatible. Read the body starting
+    // on the previous aligned hyper address, it is then moved down in place
+    // once it is received.
+    uint32_t shift = hyper_addr & 3;
+    emu->step = __PI_HYPER_EMU_SHIFT;
+    emu->count = (size & ~3) - shift;
+    __pi_hyper_copy_aligned(emu->channel, addr, hyper_addr - shift, size & ~3, NULL);
+  }
+}
 
-    if (__rt_hyper_pending_emu_size < 4)
-      prologue_size = __rt_hyper_pending_emu_size;
 
-    if (prologue_size)
-    {
-      // Case where we have a partial copy to do
-      if (!__rt_hyper_pending_emu_do_memcpy)
-      {
-        // A partial transfer must first transfer the content of the hyper
-        // to the temporary area and partially overwrite it with a memcpy.
-        // This part is first called to trigger the transfer while the part after
-        // is called to do the memcpy and the final transfer as a second step.
-        __pi_hyper_copy_aligned(
-          __rt_hyper_pending_emu_channel-1,
-          (uint32_t)__pi_hyper_temp_buffer,
-          (__rt_hyper_pending_emu_hyper_addr & ~1),
-          4,
-          NULL
-        );
-
-        // It is asynchronous, just remember we have to do
-        // a memcpy when the transfer is done and leave
-        __rt_hyper_pending_emu_do_memcpy = 1;
-        return 0;
-      }
 
-      __rt_hyper_pending_emu_do_memcpy = 0;
-      l2_memcpy(&__pi_hyper_temp_buffer[__rt_hyper_pending_emu_hyper_addr & 1], (void *)__rt_hyper_pending_emu_addr, prologue_size);
+static int __pi_hyper_resume_misaligned_read(struct pi_task *task)
+{
+  pi_hyper_emu_t *emu = __pi_hyper_emu_get(task);
 
-      __pi_hyper_copy_aligned(
-        __rt_hyper_pending_emu_channel,
-        (uint32_t)__pi_hyper_temp_buffer,
-        (__rt_hyper_pending_emu_hyper_addr & ~1),
-        4,
-        NULL
-      );
+  while (1)
+  {
+    // First finish the partial transfer which is over
+    if (emu->step == __PI_HYPER_EMU_BOUNCE)
+      l2_memcpy((void *)emu->addr, &__pi_hyper_temp_buffer[emu->hyper_addr & 3], emu->count);
+    else if (emu->step == __PI_HYPER_EMU_SHIFT)
+      __pi_hyper_shift_left((uint32_t *)emu->addr, emu->count + (emu->hyper_addr & 3), emu->hyper_addr & 3);
 
-      __rt_hyper_pending_emu_hyper_addr += prologue_size;
-      __rt_hyper_pending_emu_addr += prologue_size;
-      __rt_hyper_pending_emu_size -= prologue_size;
+    if (emu->step != __PI_HYPER_EMU_START)
+    {
+      __pi_hyper_emu_advance(emu, emu->count);
+      emu->step = __PI_HYPER_EMU_START;
+    }
 
+    if (emu->size > 0)
+    {
+      // It is asynchronous, just leave, we'll continue the transfer
+      // when this one is over
+      __pi_hyper_emu_read_step(emu);
       return 0;
     }
-    else if (__rt_hyper_pending_emu_size > 0)
-    {
-      // Case where we have the body to transfer
-      uint32_t size_aligned = __rt_hyper_pending_emu_size & ~0x3;
 
-      if ((hyper_addr_aligned & 0x1) == 0)
-      {
-        // Good case where the body is aligned on both sides and we can do
-        // a direct copy.
-        __pi_hyper_copy_aligned(
-          __rt_hyper_pending_emu_channel,
-          __rt_hyper_pending_emu_addr,
-          __rt_hyper_pending_emu_hyper_addr,
-          size_aligned,
-          NULL
-        );
-
-        __rt_hyper_pending_emu_hyper_addr += size_aligned;
-        __rt_hyper_pending_emu_addr += size_aligned;
-        __rt_hyper_pending_emu_size -= size_aligned;
-
-        // It is asynchronous, just leave, we'll continue the transfer
-        // when this one is over
-        return 0;
-      }
-      else
-      {
-        // Bad case where we have to transfer the body using a temporary
-        // buffer as the aligments on both sides are not compatible.
-        // This part is very similar to the prologue.
-        // Just be careful to split into small transfers to fit the temporary buffer.
+    if (__pi_hyper_emu_next_line(emu))
+      continue;
 
-        if (size_aligned > __PI_HYPER_TEMP_BUFFER_SIZE - 4)
-          size_aligned = __PI_HYPER_TEMP_BUFFER_SIZE - 4;
+    __rt_hyper_pending_emu_task = NULL;
+    __rt_hyper_current_task = NULL;
+    __rt_event_handle_end_of_task(task);
 
-        if (!__rt_hyper_pending_emu_do_memcpy)
-        {
-          __pi_hyper_copy_aligned(
-            __rt_hyper_pending_emu_channel-1,
-            (uint32_t)__pi_hyper_temp_buffer,
-            (__rt_hyper_pending_emu_hyper_addr & ~1),
-            4,
-            NULL
-          );
-
-          __rt_hyper_pending_emu_do_memcpy = 1;
-          return 0;
-        }
+    return 1;
+  }
+}
 
-        __rt_hyper_pending_emu_do_memcpy = 0;
-        l2_memcpy(&__pi_hyper_temp_buffer[1], (void *)__rt_hyper_pending_emu_addr, size_aligned-1);
 
-        __pi_hyper_copy_aligned(
-          __rt_hyper_pending_emu_channel,
-          (uint32_t)__pi_hyper_temp_buffer,
-          (__rt_hyper_pending_emu_hyper_addr & ~1),
-          size_aligned,
-          NULL
-        );
 
-        __rt_hyper_pending_emu_hyper_addr += size_aligned-1;
-        __rt_hyper_pending_emu_addr += size_aligned-1;
-        __rt_hyper_pending_emu_size -= size_aligned-1;
+// Starts the next partial write of the current line. Misaligned parts are
+// written with a read-modify-write of the hyper through the temporary
+// buffer, starting on a hyper address aligned on 4 bytes so that they can
+// be split on page boundaries.
+static void __pi_hyper_emu_write_step(pi_hyper_emu_t *emu)
+{
+  uint32_t addr = emu->addr;
+  uint32_t hyper_addr = emu->hyper_addr;
+  uint32_t size = emu->size;
+  uint32_t head = (-addr) & 3;
+  uint32_t count;
 
-        return 0;
-      }
-    }
+  if ((head | (size & 1)) == 0 && __pi_hyper_direct_ok(hyper_addr, size))
+  {
+    emu->step = __PI_HYPER_EMU_DIRECT;
+    emu->count = size;
+    __pi_hyper_copy_aligned(emu->channel, addr, hyper_addr, size, NULL);
+    return;
+  }
 
-    // Now check if we are done
-    if (__rt_hyper_pending_emu_size == 0)
+  if (size <= __PI_HYPER_BOUNCE_MAX)
+  {
+    count = size;
+  }
+  else if (head)
+  {
+    count = head;
+  }
+  else if (__pi_hyper_direct_ok(hyper_addr, size & ~3))
+  {
+    emu->step = __PI_HYPER_EMU_DIRECT;
+    emu->count = size & ~3;
+    __pi_hyper_copy_aligned(emu->channel, addr, hyper_addr, size & ~3, NULL);
+    return;
+  }
+  else
+  {
+    // The L2 and hyper alignments are not compatible, the body goes through
+    // the temporary buffer. The chunk size is chosen so that it ends on an
+    // aligned hyper address and only the first bytes of the hyper must be
+    // preserved.
+    count = __PI_HYPER_BOUNCE_MAX - (hyper_addr & 3);
+  }
+
+  // Only the first word must be read if the last written byte is part of the
+  // data, otherwise read everything to preserve the last one.
+  uint32_t read_size = (hyper_addr + count) & 1 ? ((hyper_addr & 3) + count + 3) & ~3 : 4;
+
+  emu->step = __PI_HYPER_EMU_RMW;
+  emu->count = count;
+  __pi_hyper_copy_aligned(emu->channel - 1, (uint32_t)__pi_hyper_temp_buffer, hyper_addr & ~3, read_size, NULL);
+}
+
+
+
+static int __pi_hyper_resume_misaligned_write(struct pi_task *task)
+{
+  pi_hyper_emu_t *emu = __pi_hyper_emu_get(task);
+
+  while (1)
+  {
+    if (emu->step == __PI_HYPER_EMU_RMW)
     {
-      // Check if we are doing a 2D transfer
-      if (__rt_hyper_pending_emu_size_2d > 0)
-      {
-        // In this case, update the global size
-        if (__rt_hyper_pending_emu_size_2d > __rt_hyper_pending_emu_length)
-          __rt_hyper_pending_emu_size_2d -= __rt_hyper_pending_emu_length;
-        else
-          __rt_hyper_pending_emu_size_2d = 0;
-
-        // And check if we must reenqueue a line.
-        if (__rt_hyper_pending_emu_size_2d > 0)
-        {
-          __rt_hyper_pending_emu_hyper_addr = __rt_hyper_pending_emu_hyper_addr - __rt_hyper_pending_emu_length + __rt_hyper_pending_emu_stride;
-          __rt_hyper_pending_emu_size = __rt_hyper_pending_emu_size_2d > __rt_hyper_pending_emu_length ? __rt_hyper_pending_emu_length : __rt_hyper_pending_emu_size_2d;
-          continue;
-        }
-      }
+      // The hyper content around the data is now in the temporary buffer,
+      // patch it with the data and write it back.
+      uint32_t hyper_addr = emu->hyper_addr;
+      l2_memcpy(&__pi_hyper_temp_buffer[hyper_addr & 3], (void *)emu->addr, emu->count);
 
-      __rt_hyper_pending_emu_task = NULL;
-      __rt_hyper_current_task = NULL;
-      __rt_event_handle_end_of_task(task);
+      emu->step = __PI_HYPER_EMU_DIRECT;
+      __pi_hyper_copy_aligned(emu->channel, (uint32_t)__pi_hyper_temp_buffer, hyper_addr & ~3, (emu->count + (hyper_addr & 3) + 1) & ~1, NULL);
+      return 0;
+    }
 
-      return 1;
+    if (emu->step != __PI_HYPER_EMU_START)
+    {
+      __pi_hyper_emu_advance(emu, emu->count);
+      emu->step = __PI_HYPER_EMU_START;
     }
-    break;
-  }
 
-  return 0;
+    if (emu->size > 0)
+    {
+      __pi_hyper_emu_write_step(emu);
+      return 0;
+    }
+
+    if (__pi_hyper_emu_next_line(emu))
+      continue;
+
+    __rt_hyper_pending_emu_task = NULL;
+    __rt_hyper_current_task = NULL;
+    __rt_event_handle_end_of_task(task);
+
+    return 1;
+  }
 }
 
 
@@ -781,7 +883,7 @@ static int __pi_hyper_resume_misaligned_write(struct pi_task *task)
 static void __pi_hyper_copy_misaligned(struct pi_task *task)
 {
     int end;
-    if (__rt_hyper_pending_emu_channel & 1)
+    if (__pi_hyper_emu_get(task)->channel & 1)
       end = __pi_hyper_resume_misaligned_write(task);
     else
       end = __pi_hyper_resume_misaligned_read(task);
@@ -794,60 +896,154 @@ static void __pi_hyper_copy_misaligned(struct pi_task *task)
 
 
 
+static void __pi_hyper_emu_init(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, uint32_t size_2d, uint32_t stride, uint32_t length, pi_task_t *event)
+{
+  pi_hyper_emu_t *emu = __pi_hyper_emu_get(event);
+
+  emu->channel = channel;
+  emu->step = __PI_HYPER_EMU_START;
+  emu->hyper_addr = hyper_addr;
+  emu->addr = addr;
+  emu->size = size;
+  emu->size_2d = size_2d;
+  emu->length = length;
+  emu->stride = stride;
+  emu->plane_size = 0;
+
+  __rt_hyper_pending_emu_task = event;
+}
+
+
+
 static void __pi_hyper_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event)
 {
   __rt_hyper_current_task = event;
 
   // Check if we are in the fast case where everything is correctly aligned.
-  if (likely((((int)addr & 0x3) == 0) && (((int)hyper_addr) & 0x1) == 0 && (((int)size & 0x3) == 0 || ((channel & 1) && ((int)size & 0x1) == 0))))
+  if (likely((((int)addr & 0x3) == 0) && __pi_hyper_direct_ok(hyper_addr, size) && (((int)size & 0x3) == 0 || ((channel & 1) && ((int)size & 0x1) == 0))))
   {
     __pi_hyper_copy_aligned(channel, addr, hyper_addr, size, event);
   }
   else
   {
     // Otherwise go through the slow misaligned case.
-    __rt_hyper_pending_emu_channel = channel;
-    __rt_hyper_pending_emu_hyper_addr = (unsigned int)hyper_addr;
-    __rt_hyper_pending_emu_addr = (unsigned int)addr;
-    __rt_hyper_pending_emu_size = size;
-    __rt_hyper_pending_emu_do_memcpy = 0;
-    __rt_hyper_pending_emu_task = event;
-
+    __pi_hyper_emu_init(channel, addr, hyper_addr, size, 0, 0, 0, event);
     __pi_hyper_copy_misaligned(event);
   }
 }
 
 
 
-static void __pi_hyper_2d_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, uint32_t length, pi_task_t *event)
+static void __pi_hyper_2d_copy_exec(int channel, uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *event)
 {
   __rt_hyper_current_task = event;
 
-  // Otherwise go through the slow misaligned case.
-  __rt_hyper_pending_emu_channel = channel;
-  __rt_hyper_pending_emu_hyper_addr = hyper_addr;
-  __rt_hyper_pending_emu_addr = (unsigned int)addr;
-  __rt_hyper_pending_emu_size = size > length ? length : size;
-  __rt_hyper_pending_emu_do_memcpy = 0;
-  __rt_hyper_pending_emu_task = event;
-  __rt_hyper_pending_emu_size_2d = size;
-  __rt_hyper_pending_emu_length = length;
-  __rt_hyper_pending_emu_stride = stride;
+  // 2D and 3D copies always go through the emulation, which executes them
+  // line by line
+  __pi_hyper_emu_init(channel, addr, hyper_addr, size > length ? length : size, size, stride, length, event);
+
+  if (length_3d)
+  {
+    pi_hyper_emu_t *emu = __pi_hyper_emu_get(event);
+    emu->plane_hyper_addr = hyper_addr;
+    emu->plane_size = length_3d;
+    emu->plane_stride = stride_3d;
+    emu->plane_remaining = length_3d;
+  }
 
   __pi_hyper_copy_misaligned(event);
 }
 
 
 
+static struct pi_task *__pi_hyper_pending_pop()
+{
+  struct pi_task *task = __rt_hyper_pending_tasks;
+  __rt_hyper_pending_tasks = task->implem.next;
+  if (task == __rt_hyper_pending_tasks_prio_last)
+    __rt_hyper_pending_tasks_prio_last = NULL;
+  return task;
+}
+
+
+
+static void __pi_hyper_pending_push(struct pi_task *task, int prio)
+{
+  if (prio)
+  {
+    // Cluster requests go in front of the normal ones, after the other
+    // high-priority ones to keep their order.
+    struct pi_task *prev = __rt_hyper_pending_tasks_prio_last;
+    if (prev)
+    {
+      task->implem.next = prev->implem.next;
+      prev->implem.next = task;
+    }
+    else
+    {
+      task->implem.next = __rt_hyper_pending_tasks;
+      __rt_hyper_pending_tasks = task;
+    }
+
+    if (task->implem.next == NULL)
+      __rt_hyper_pending_tasks_last = task;
+
+    __rt_hyper_pending_tasks_prio_last = task;
+  }
+  else
+  {
+    if (__rt_hyper_pending_tasks != NULL)
+      __rt_hyper_pending_tasks_last->implem.next = task;
+    else
+      __rt_hyper_pending_tasks = task;
+    __rt_hyper_pending_tasks_last = task;
+    task->implem.next = NULL;
+  }
+}
+
+
+
+// Two 1D requests can be done with one transfer if they are in the same
+// direction and contiguous both in L2 and in the hyper.
+static inline int __pi_hyper_can_merge(struct pi_task *task, struct pi_task *next)
+{
+  uint32_t size = task->implem.data[3];
+
+  return (next->implem.data[0] & ~__PI_HYPER_PENDING_PRIO) == (task->implem.data[0] & 0xff) &&
+    task->implem.data[1] + size == next->implem.data[1] &&
+    task->implem.data[2] + size == next->implem.data[2];
+}
+
+
+
+static void __pi_hyper_merge_done(void *arg)
+{
+  int irq = rt_irq_disable();
+
+  struct pi_task *task = __rt_hyper_merge_first;
+  __rt_hyper_merge_busy = 0;
+
+  while (task)
+  {
+    struct pi_task *next = task->implem.next;
+    __rt_event_handle_end_of_task(task);
+    task = next;
+  }
+
+  rt_irq_restore(irq);
+}
+
+
+
 static void exec_pending_task()
 {
   struct pi_task *task = __rt_hyper_pending_tasks;
 
   if (task)
   {
-    __rt_hyper_pending_tasks = task->implem.next;
+    task = __pi_hyper_pending_pop();
 
-    int is_2d = (task->implem.data[0] >> 8) & 0xff;
+    int is_2d = task->implem.data[0] & __PI_HYPER_PENDING_2D;
     unsigned int channel = task->implem.data[0] & 0xff;
     uint32_t addr = task->implem.data[1];
     uint32_t hyper_addr = task->implem.data[2];
@@ -855,39 +1051,64 @@ static void exec_pending_task()
 
     if (!is_2d)
     {
+      struct pi_task *next = __rt_hyper_pending_tasks;
+
+      // Merge the following requests as long as they extend this one, so
+      // that they are done with a single transfer. The merged tasks can
+      // only be notified once the merge task is free again.
+      if (next && !__rt_hyper_merge_busy && __pi_hyper_can_merge(task, next))
+      {
+        struct pi_task *last = task;
+        __rt_hyper_merge_first = task;
+
+        do
+        {
+          next = __pi_hyper_pending_pop();
+          size += next->implem.data[3];
+          last->implem.next = next;
+          last = next;
+          next = __rt_hyper_pending_tasks;
+        }
+        while (next && __pi_hyper_can_merge(last, next));
+
+        last->implem.next = NULL;
+        __rt_hyper_merge_busy = 1;
+        task = &__rt_hyper_merge_task;
+        pi_task_callback(task, __pi_hyper_merge_done, NULL);
+      }
+
       __pi_hyper_copy_exec(channel, addr, hyper_addr, size, task);
     }
     else
     {
       uint32_t stride = task->implem.data[4];
       uint32_t length = task->implem.data[5];
-      __pi_hyper_2d_copy_exec(channel, addr, hyper_addr, size, stride, length, task);
+      uint32_t stride_3d = 0, length_3d = 0;
+      if (task->implem.data[0] & __PI_HYPER_PENDING_3D)
+      {
+        stride_3d = task->implem.data[6];
+        length_3d = task->implem.data[7];
+      }
+      __pi_hyper_2d_copy_exec(channel, addr, hyper_addr, size, stride, length, stride_3d, length_3d, task);
     }
   }
 }
 
 
 
-// TODO this should be done using UDMA
+// The copies done here are limited to the temporary buffer and are needed
+// before the next step of the state machine, so they are done synchronously
+// with the fast copy of the FC copy service.
 static inline void *l2_memcpy(void *dst0, const void *src0, size_t len0)
 {
-  char *dst = (char *) dst0;
-  char *src = (char *) src0;
-
-  void *save = dst0;
-
-  while (len0--)
-    {
-      *dst++ = *src++;
-    }
-
-  return save;
+  __rt_memcpy_fast(dst0, src0, len0);
+  return dst0;
 }
 
 
 
 void __pi_hyper_copy(int channel,
-  uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event, int cs)
+  uint32_t addr, uint32_t hyper_addr, uint32_t size, pi_task_t *event, int cs, int prio)
 {
   int irq = rt_irq_disable();
 
@@ -896,14 +1117,9 @@ void __pi_hyper_copy(int channel,
 
   if (__rt_hyper_current_task != NULL)
   {
-    if (__rt_hyper_pending_tasks != NULL)
-    __rt_hyper_pending_tasks_last->implem.next = event;
-    else
-      __rt_hyper_pending_tasks = event;
-    __rt_hyper_pending_tasks_last = event;
-    event->implem.next = NULL;
+    __pi_hyper_pending_push(event, prio);
 
-    event->implem.data[0] = channel;
+    event->implem.data[0] = channel | (prio ? __PI_HYPER_PENDING_PRIO : 0);
     event->implem.data[1] = (unsigned int)addr;
     event->implem.data[2] = (unsigned int)hyper_addr;
     event->implem.data[3] = size;
@@ -919,7 +1135,7 @@ void __pi_hyper_copy(int channel,
 
 
 void __pi_hyper_copy_2d(int channel,
-  uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, int length, pi_task_t *event, int cs)
+  uint32_t addr, uint32_t hyper_addr, uint32_t size, int stride, int length, pi_task_t *event, int cs, int prio)
 {
   int irq = rt_irq_disable();
 
@@ -928,23 +1144,49 @@ void __pi_hyper_copy_2d(int channel,
 
   if (__rt_hyper_current_task != NULL)
   {
-    if (__rt_hyper_pending_tasks != NULL)
-    __rt_hyper_pending_tasks_last->implem.next = event;
-    else
-      __rt_hyper_pending_tasks = event;
-    __rt_hyper_pending_tasks_last = event;
-    event->implem.next = NULL;
+    __pi_hyper_pending_push(event, prio);
+
+    event->implem.data[0] = channel | __PI_HYPER_PENDING_2D | (prio ? __PI_HYPER_PENDING_PRIO : 0);
+    event->implem.data[1] = (unsigned int)addr;
+    event->implem.data[2] = (unsigned int)hyper_addr;
+    event->implem.data[3] = size;
+    event->implem.data[4] = stride;
+    event->implem.data[5] = length;
+  }
+  else
+  {
+    __pi_hyper_2d_copy_exec(channel, addr, hyper_addr, size, stride, length, 0, 0, event);
+  }
 
-    event->implem.data[0] = channel | (1<<8);
+  rt_irq_restore(irq);
+}
+
+
+
+static void __pi_hyper_copy_3d(int channel,
+  uint32_t addr, uint32_t hyper_addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *event, int cs)
+{
+  int irq = rt_irq_disable();
+
+  if (cs)
+    hyper_addr |= REG_MBR1;
+
+  if (__rt_hyper_current_task != NULL)
+  {
+    __pi_hyper_pending_push(event, 0);
+
+    event->implem.data[0] = channel | __PI_HYPER_PENDING_2D | __PI_HYPER_PENDING_3D;
     event->implem.data[1] = (unsigned int)addr;
     event->implem.data[2] = (unsigned int)hyper_addr;
     event->implem.data[3] = size;
     event->implem.data[4] = stride;
     event->implem.data[5] = length;
+    event->implem.data[6] = stride_3d;
+    event->implem.data[7] = length_3d;
   }
   else
   {
-    __pi_hyper_2d_copy_exec(channel, addr, hyper_addr, size, stride, length, event);
+    __pi_hyper_2d_copy_exec(channel, addr, hyper_addr, size, stride, length, stride_3d, length_3d, event);
   }
 
   rt_irq_restore(irq);
@@ -972,11 +1214,11 @@ static void __attribute__((constructor)) __rt_hyper_init()
   __rt_hyper_end_task = NULL;
   __rt_hyper_current_task = NULL;
   __rt_hyper_pending_tasks = NULL;
+  __rt_hyper_pending_tasks_prio_last = NULL;
+  __rt_hyper_merge_busy = 0;
   __pi_hyper_cluster_reqs_first = NULL;
-  __rt_hyper_pending_emu_channel = -1;
+  __rt_hyper_pending_emu_task = NULL;
   __rt_hyper_open_count = 0;
-  __rt_hyper_pending_emu_size = 0;
-  __rt_hyper_pending_emu_size_2d = 0;
 }
 
 
@@ -989,10 +1231,17 @@ static void __pi_hyper_cluster_req_exec(pi_cl_hyper_req_t *req)
   pi_task_t *event = &__pi_hyper_cluster_task;
   pi_task_callback(event, __pi_hyper_cluster_req_done, (void* )req);
 
-  if(req->is_2d)
-    __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, req->stride, req->length, event, hyper->cs);
+  if (hyper->cache && !req->is_2d)
+  {
+    if (req->is_write)
+      pi_hyper_cache_write_async(hyper->cache, req->hyper_addr, req->addr, req->size, event);
+    else
+      pi_hyper_cache_read_async(hyper->cache, req->hyper_addr, req->addr, req->size, event);
+  }
+  else if(req->is_2d)
+    __pi_hyper_copy_2d(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, req->stride, req->length, event, hyper->cs, 1);
   else
-    __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, event, hyper->cs);
+    __pi_hyper_copy(UDMA_CHANNEL_ID(hyper->channel) + req->is_write, (uint32_t)req->addr, req->hyper_addr, req->size, event, hyper->cs, 1);
 }
 
 static void __pi_hyper_cluster_req_done(void *_req)
@@ -20,9 +20,6 @@
 
 #include "pmsis.h"
 
-extern void __pos_i2s_handle_copy_asm();
-
-
 static int __pos_i2s_global_open_count;
 
 static pos_i2s_t __pos_i2s[ARCHI_UDMA_NB_I2S];
@@ -51,30 +48,6 @@ void pi_i2s_conf_init(struct pi_i2s_conf *conf)
 }
 
 
-void __pos_i2s_handle_copy(pos_i2s_t *i2s)
-{
-    if (i2s->reenqueue)
-    {
-        unsigned int base = hal_udma_channel_base(i2s->channel);
-        int buffer = i2s->current_buffer;
-        plp_udma_enqueue(base, (int)i2s->conf.pingpong_buffers[buffer], i2s->conf.block_size, UDMA_CHANNEL_CFG_EN | UDMA_CHANNEL_CFG_SIZE_16);
-        i2s->current_buffer = buffer ^ 1;
-    }
-
-    pi_task_t *waiting = i2s->waiting_first;
-
-    if (waiting)
-    {
-        i2s->waiting_first = waiting->implem.next;
-        __rt_event_enqueue(waiting);
-    }
-    else
-    {
-        i2s->nb_ready_buffer++;
-    }
-}
-
-
 int pi_i2s_open(struct pi_device *device)
 {
     int irq = rt_irq_disable();
@@ -106,11 +79,12 @@ int pi_i2s_open(struct pi_device *device)
         int pdm = (i2s->conf.format & PI_I2S_FMT_DATA_FORMAT_MASK) == PI_I2S_FMT_DATA_FORMAT_PDM;
 
         i2s->channel = channel_id;
-        i2s->reenqueue = 0;
+        i2s->stream.running = 0;
+        i2s->stream.nb_armed = 0;
         if (conf->word_size == 16)
-            i2s->udma_cfg = UDMA_CHANNEL_CFG_EN | UDMA_CHANNEL_CFG_SIZE_16;
+            i2s->udma_cfg = UDMA_CHANNEL_CFG_SIZE_16;
         else
-            i2s->udma_cfg = UDMA_CHANNEL_CFG_EN | UDMA_CHANNEL_CFG_SIZE_32;
+            i2s->udma_cfg = UDMA_CHANNEL_CFG_SIZE_32;
 
         i2s->i2s_freq = i2s->conf.frame_clk_freq;
 
@@ -118,8 +92,9 @@ int pi_i2s_open(struct pi_device *device)
         // Activate routing of UDMA i2s soc events to FC to trigger interrupts
         soc_eu_fcEventMask_setEvent(channel_id);
 
-        // Redirect all UDMA i2s events to a specific callback
-        __rt_udma_register_channel_callback(channel_id, __pos_i2s_handle_copy_asm, (void *)i2s);
+        // Redirect all UDMA i2s events to the generic stream handler, which
+        // re-arms the ping-pong buffers
+        __rt_udma_register_channel_callback(channel_id, __rt_udma_handle_stream, (void *)&i2s->stream);
 
         i2s->clk = __pos_i2s_flags & PI_I2S_SETUP_SINGLE_CLOCK ? 0 : sub_periph_id;
 
@@ -186,7 +161,7 @@ static inline void __pos_i2s_suspend(pos_i2s_t *i2s)
 {
     unsigned int base = hal_udma_channel_base(i2s->channel);
 
-    i2s->reenqueue = 0;
+    __rt_udma_stream_stop(&i2s->stream);
 
     // Stop the clock now
     hal_i2s_cfg_clkgen_set(i2s->conf.itf, i2s->clk, 0);
@@ -203,7 +178,8 @@ static inline void __pos_i2s_suspend(pos_i2s_t *i2s)
     // Then clear the channels so that we start from a clean state the next time.
     rt_irq_disable();
     plp_udma_clr(base);
-    i2s->nb_ready_buffer = 0;
+    __rt_udma_stream_flush(&i2s->stream);
+    i2s->stream.nb_filled = 0;
 }
 
 
@@ -239,18 +215,9 @@ static inline void __pos_i2s_resume(pos_i2s_t *i2s)
     int periph_freq = __rt_freq_periph_get();
     int div = periph_freq / i2s->i2s_freq;
 
-    unsigned int base = hal_udma_channel_base(i2s->channel);
-
     rt_trace(RT_TRACE_CAM, "[I2S] Resuming (i2s: %d, clk: %d, periph_freq: %d, i2s_freq: %d, div: %d)\n", i2s->conf.itf, itf->clk, periph_freq, itf->conf.frame_clk_freq, div);
   
-    i2s->reenqueue = 1;
-    i2s->current_buffer = 0;
-    i2s->current_read_buffer = 0;
-    i2s->nb_ready_buffer = 0;
-    i2s->waiting_first = NULL;
-
-    plp_udma_enqueue(base, (int)i2s->conf.pingpong_buffers[0], i2s->conf.block_size, i2s->udma_cfg);
-    plp_udma_enqueue(base, (int)i2s->conf.pingpong_buffers[1], i2s->conf.block_size, i2s->udma_cfg);
+    __rt_udma_stream_start(&i2s->stream, i2s->channel, i2s->conf.pingpong_buffers, 2, i2s->conf.block_size, i2s->udma_cfg);
 
     unsigned int conf = 
         UDMA_I2S_CFG_CLKGEN0_BITS_WORD(i2s->conf.word_size - 1) | 
@@ -293,34 +260,20 @@ int pi_i2s_read_async(struct pi_device *device, pi_task_t *task)
 {
     pos_i2s_t *i2s = (pos_i2s_t *)device->data;
 
-    int irq = rt_irq_disable();
-
-    // Prepare now the task results, the IRQ handler can still overwrite
-    // them if they are different.
-    task->implem.data[0] = 0;
-    task->implem.data[1] = (int)i2s->conf.pingpong_buffers[i2s->current_read_buffer];
-    task->implem.data[2] = i2s->conf.block_size;
-    i2s->current_read_buffer ^= 1;
-
-    if (i2s->nb_ready_buffer)
-    {
-        i2s->nb_ready_buffer--;
-        __rt_event_enqueue(task);
-    }
-    else
-    {
-        if (i2s->waiting_first)
-            i2s->waiting_last->implem.next = task;
-        else
-            i2s->waiting_first = task;
+    // The buffer returned by the previous read is given back to the stream
+    // when the next one is requested, as the application reads them in a
+    // ping-pong way.
+    __rt_udma_stream_release(&i2s->stream);
+    __rt_udma_stream_acquire(&i2s->stream, task);
 
-        task->implem.next = NULL;
-        i2s->waiting_last = task;
-    }
+    return 0;
+}
 
-    rt_irq_restore(irq);
 
-    return 0;
+uint32_t pi_i2s_overruns_get(struct pi_device *device)
+{
+    pos_i2s_t *i2s = (pos_i2s_t *)device->data;
+    return i2s->stream.nb_overruns;
 }
 
 
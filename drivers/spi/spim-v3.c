@@ -24,9 +24,14 @@
 
 L2_DATA static pi_spim_t __rt_spim[ARCHI_UDMA_NB_SPIM];
 
-typedef struct 
+typedef struct pi_spim_cs_s
 {
   pi_spim_t *spim;
+  struct pi_spim_cs_s *next;
+  pi_task_t *waiting_first;
+  pi_task_t *waiting_last;
+  int priority;
+  int skipped;
   int max_baudrate;
   unsigned int cfg;
   unsigned int periph_base;
@@ -44,9 +49,19 @@ typedef struct {
     unsigned int cmd[4];
 } rt_spim_cmd_t;
 
+// Number of times a chip select with waiting transfers can be skipped by
+// the arbiter in favor of higher priority ones before it wins anyway.
+#define __PI_SPIM_ARBITER_MAX_SKIP 8
+
+// Size in bits of the chunks into which large transfers are split, which
+// is the biggest transfer the uDMA can do at once
+#define __PI_SPIM_CHUNK_LEN (8192*8)
+
 
 void __pi_handle_waiting_copy(pi_task_t *task);
 
+void __pi_spim_exec_waiting(pi_spim_t *spim);
+
 void __rt_spi_handle_repeat(void *arg);
 
 
@@ -66,12 +81,8 @@ void __pi_spim_handle_eot(int event, void *arg)
   spim->pending_copy = NULL;
   __rt_event_handle_end_of_task(task);
 
-  task = spim->waiting_first;
-  if (task)
-  {
-    spim->waiting_first = task->implem.next;
-    __pi_handle_waiting_copy(task);
-  }
+  if (spim->waiting_first)
+    __pi_spim_exec_waiting(spim);
 }
 
 void __rt_spim_handle_rx_copy(int event, void *arg)
@@ -96,6 +107,121 @@ extern void __pi_spim_handle_eot(void *arg);
 
 
 
+// Chooses the chip select whose first waiting transfer is executed next.
+// While a chip select is locked by transfers keeping it active, only this
+// one can be chosen so that such sequences are not interleaved with other
+// devices. Otherwise the highest priority wins. Chip selects are scanned
+// in round-robin order from the last chosen one so that devices with the
+// same priority are served fairly, and one skipped too many times wins
+// anyway so that low priorities are not starved.
+static pi_spim_cs_t *__pi_spim_arbiter_pick(pi_spim_t *spim)
+{
+  pi_spim_cs_t *locked = (pi_spim_cs_t *)spim->locked_cs;
+  if (locked)
+    return locked->waiting_first ? locked : NULL;
+
+  pi_spim_cs_t *last = (pi_spim_cs_t *)spim->last_cs;
+  pi_spim_cs_t *first = last && last->next ? last->next : (pi_spim_cs_t *)spim->cs_first;
+  pi_spim_cs_t *cs = first;
+  pi_spim_cs_t *best = NULL;
+
+  if (cs == NULL)
+    return NULL;
+
+  do
+  {
+    if (cs->waiting_first)
+    {
+      if (cs->skipped >= __PI_SPIM_ARBITER_MAX_SKIP)
+        return cs;
+
+      if (best == NULL || cs->priority > best->priority)
+        best = cs;
+    }
+
+    cs = cs->next ? cs->next : (pi_spim_cs_t *)spim->cs_first;
+  }
+  while (cs != first);
+
+  return best;
+}
+
+
+
+// The waiting_first field of the bus points to the transfer the arbiter
+// would execute next, so that the end of transfer handler can quickly see
+// if something must be executed.
+static void __pi_spim_arbiter_update(pi_spim_t *spim)
+{
+  pi_spim_cs_t *cs = __pi_spim_arbiter_pick(spim);
+  spim->waiting_first = cs ? cs->waiting_first : NULL;
+}
+
+
+
+// Puts a transfer on hold in the queue of its chip select. Returns 1 if it
+// must wait because the bus is used by another transfer or locked by
+// another chip select.
+static int __pi_spim_wait(pi_spim_t *spim, pi_spim_cs_t *spim_cs, pi_task_t *task)
+{
+  if (spim->pending_copy == NULL && (spim->locked_cs == NULL || spim->locked_cs == spim_cs))
+    return 0;
+
+  if (spim_cs->waiting_first)
+    spim_cs->waiting_last->implem.next = task;
+  else
+    spim_cs->waiting_first = task;
+
+  spim_cs->waiting_last = task;
+  task->implem.next = NULL;
+
+  __pi_spim_arbiter_update(spim);
+
+  return 1;
+}
+
+
+
+// Marks the bus as used by a transfer. The bus stays locked to the chip
+// select after the transfer if it keeps the chip select active.
+static void __pi_spim_start(pi_spim_t *spim, pi_spim_cs_t *spim_cs, pi_task_t *task, int cs_keep)
+{
+  spim->pending_copy = task;
+  spim->locked_cs = cs_keep ? spim_cs : NULL;
+  __pi_spim_arbiter_update(spim);
+}
+
+
+
+// Called at the end of a transfer when one is waiting, to execute the one
+// chosen by the arbiter.
+void __pi_spim_exec_waiting(pi_spim_t *spim)
+{
+  pi_spim_cs_t *chosen = __pi_spim_arbiter_pick(spim);
+
+  if (chosen == NULL)
+  {
+    spim->waiting_first = NULL;
+    return;
+  }
+
+  pi_task_t *task = chosen->waiting_first;
+  chosen->waiting_first = task->implem.next;
+
+  for (pi_spim_cs_t *cs = (pi_spim_cs_t *)spim->cs_first; cs; cs = cs->next)
+  {
+    if (cs->waiting_first && cs != chosen)
+      cs->skipped++;
+  }
+
+  chosen->skipped = 0;
+  spim->last_cs = chosen;
+
+  __pi_handle_waiting_copy(task);
+}
+
+
+
 static int __rt_spi_get_div(int spi_freq)
 {
   int periph_freq = __rt_freq_periph_get();
@@ -150,6 +276,11 @@ int pi_spi_open(struct pi_device *device)
   spim_cs->max_baudrate = conf->max_baudrate;
   spim_cs->cs = conf->cs;
   spim_cs->byte_align = __rt_spim_get_byte_align(conf->wordsize, conf->big_endian);
+  spim_cs->waiting_first = NULL;
+  spim_cs->priority = 0;
+  spim_cs->skipped = 0;
+  spim_cs->next = (pi_spim_cs_t *)spim->cs_first;
+  spim->cs_first = spim_cs;
 
   int div = __rt_spi_get_div(spim_cs->max_baudrate);
   spim_cs->div = div;
@@ -214,6 +345,30 @@ void pi_spi_close(struct pi_device *device)
 
   int channel = UDMA_EVENT_ID(spim_cs->channel);
 
+  pi_spim_cs_t *prev = NULL;
+  for (pi_spim_cs_t *cs = (pi_spim_cs_t *)spim->cs_first; cs; prev = cs, cs = cs->next)
+  {
+    if (cs == spim_cs)
+    {
+      if (prev)
+        prev->next = cs->next;
+      else
+        spim->cs_first = cs->next;
+      break;
+    }
+  }
+
+  if (spim->last_cs == spim_cs)
+    spim->last_cs = NULL;
+  // Transfers of other devices may be waiting for the bus to be unlocked
+  if (spim->locked_cs == spim_cs)
+  {
+    spim->locked_cs = NULL;
+    __pi_spim_arbiter_update(spim);
+    if (spim->pending_copy == NULL && spim->waiting_first)
+      __pi_spim_exec_waiting(spim);
+  }
+
   spim->open_count--;
 
   if (spim->open_count == 0)
@@ -228,93 +383,95 @@ void pi_spi_close(struct pi_device *device)
   rt_irq_restore(irq);
 }
 
-void __rt_spi_handle_repeat(void *arg)
+// Gets the command which transfers len bits of data, for a send (mode 1),
+// a receive (mode 0) or a full duplex transfer (mode 2).
+static inline unsigned int __pi_spim_data_cmd(int mode, unsigned int len, int qspi)
 {
-  int irq = rt_irq_disable();
+  if (mode == 0)
+    return SPI_CMD_RX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST);
+  else if (mode == 1)
+    return SPI_CMD_TX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST);
+  else
+    return SPI_CMD_FUL(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, SPI_CMD_MSB_FIRST);
+}
 
-  pi_spim_t *spim = (pi_spim_t *)arg;
+
+
+// Enqueues the next chunk of a large transfer. Each chunk ends with an EOT
+// which keeps the chip select active, except for the last one. The chunk
+// is queued behind the running one in the second uDMA slot of the channels
+// so that it starts as soon as the running one is over, without waiting
+// for the handler.
+static void __pi_spim_repeat_enqueue(pi_spim_t *spim)
+{
   pi_spim_cs_t *spim_cs = (pi_spim_cs_t *)spim->pending_repeat_device->data;
-  unsigned int len = spim->pending_repeat_len;
+  unsigned int len = spim->pending_repeat_enqueue_len;
   int cs_mode = (spim->pending_repeat_flags >> 0) & 0x3;
   int qspi = (spim->pending_repeat_flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
-  if (len > 8192*8)
-  {
-    len = 8192*8;
-  }
-  spim->pending_repeat_len -= len;
+  int mode = spim->pending_repeat_send;
+  unsigned int *cmd = spim->pending_repeat_cmd[spim->pending_repeat_slot];
+  int cfg = UDMA_CHANNEL_CFG_SIZE_32 | UDMA_CHANNEL_CFG_EN;
+
+  if (len > __PI_SPIM_CHUNK_LEN)
+    len = __PI_SPIM_CHUNK_LEN;
+
+  spim->pending_repeat_enqueue_len -= len;
+  spim->pending_repeat_slot ^= 1;
+
   int size = (len + 7) >> 3;
+  int last = spim->pending_repeat_enqueue_len == 0;
 
-#if 0
-  if (spim->pending_repeat_send == 1)
-  {
-    spim->udma_cmd[0] = SPI_CMD_TX_DATA(len, qspi, spim_cs->byte_align);
+  cmd[0] = SPI_CMD_SOT(spim_cs->cs);
+  cmd[1] = __pi_spim_data_cmd(mode, len, qspi);
+  cmd[2] = SPI_CMD_EOT(1, !last || cs_mode == RT_SPIM_CS_KEEP);
 
-    plp_udma_enqueue(spim->pending_repeat_base, (unsigned int)spim->udma_cmd, 1*4, UDMA_CHANNEL_CFG_EN);
-    while(plp_udma_busy(spim->pending_repeat_base));
+  if (mode != 1)
+    plp_udma_enqueue(spim_cs->periph_base + UDMA_CHANNEL_RX_OFFSET, spim->pending_repeat_addr, size, cfg);
 
-    if (spim->pending_repeat_len == 0 && cs_mode == PI_SPI_CS_AUTO)
-    {
-      plp_udma_enqueue(spim->pending_repeat_base, spim->pending_repeat_addr, size, UDMA_CHANNEL_CFG_EN);
-      spim->udma_cmd[0] = SPI_CMD_EOT(1);
-      plp_udma_enqueue(spim->pending_repeat_base, (unsigned int)spim->udma_cmd, 1*4, UDMA_CHANNEL_CFG_EN);
-    }
-    else
-    {
-      soc_eu_fcEventMask_setEvent(spim_cs->channel + 1);
-      plp_udma_enqueue(spim->pending_repeat_base, spim->pending_repeat_addr, size, UDMA_CHANNEL_CFG_EN);
-      spim->pending_repeat_addr += size;
-    }
-  }
-  else if (spim->pending_repeat_send == 2)
-  {
-    unsigned int tx_base = hal_udma_channel_base(spim_cs->channel + 1);
-    unsigned int rx_base = hal_udma_channel_base(spim_cs->channel);
+  if (mode == 1)
+    plp_udma_enqueue(spim_cs->periph_base + UDMA_CHANNEL_TX_OFFSET, spim->pending_repeat_addr, size, cfg);
+  else if (mode == 2)
+    plp_udma_enqueue(spim_cs->periph_base + UDMA_CHANNEL_TX_OFFSET, spim->pending_repeat_dup_addr, size, cfg);
 
-    spim->udma_cmd[0] = SPI_CMD_FUL(len, spim_cs->byte_align);
+  plp_udma_enqueue(spim_cs->periph_base + ARCHI_SPIM_CMD_OFFSET, (unsigned int)cmd, 3*4, cfg);
 
-    plp_udma_enqueue(tx_base, (unsigned int)spim->udma_cmd, 1*4, UDMA_CHANNEL_CFG_EN);
+  spim->pending_repeat_addr += size;
+  spim->pending_repeat_dup_addr += size;
+}
 
-    if (spim->pending_repeat_len == 0 && cs_mode == PI_SPI_CS_AUTO)
-    {
-      plp_udma_enqueue(rx_base, (unsigned int)spim->pending_repeat_addr, size, UDMA_CHANNEL_CFG_EN | (2<<1));
-      plp_udma_enqueue(tx_base, (unsigned int)spim->pending_repeat_dup_addr, size, UDMA_CHANNEL_CFG_EN);
-      while(!plp_udma_canEnqueue(tx_base));
-      spim->udma_cmd[0] = SPI_CMD_EOT(1);
-      plp_udma_enqueue(tx_base, (unsigned int)spim->udma_cmd, 1*4, UDMA_CHANNEL_CFG_EN);
-    }
-    else
-    {
-      while(plp_udma_busy(tx_base));
-      soc_eu_fcEventMask_setEvent(spim_cs->channel);
-      plp_udma_enqueue(rx_base, (unsigned int)spim->pending_repeat_addr, size, UDMA_CHANNEL_CFG_EN | (2<<1));
-      plp_udma_enqueue(tx_base, (unsigned int)spim->pending_repeat_dup_addr, size, UDMA_CHANNEL_CFG_EN);
-      spim->pending_repeat_addr += size;
-      spim->pending_repeat_dup_addr += size;
-    }
-  }
-  else
-  {
-    int cmd_size = 0;
-    unsigned int tx_base = hal_udma_channel_base(spim_cs->channel + 1);
-    unsigned int rx_base = hal_udma_channel_base(spim_cs->channel);
 
-    spim->udma_cmd[cmd_size++] = SPI_CMD_RX_DATA(len, qspi, spim_cs->byte_align);
 
-    if (spim->pending_repeat_len == 0 && cs_mode == PI_SPI_CS_AUTO)
-    {
-      spim->udma_cmd[cmd_size++] = SPI_CMD_EOT(1);
-    }
-    else
-    {
-      soc_eu_fcEventMask_setEvent(spim_cs->channel);
-    }
+// Prepares a transfer of more than one chunk. The first chunk is enqueued
+// by the caller with its header and the second one is queued behind it.
+static void __pi_spim_repeat_start(pi_spim_t *spim, struct pi_device *device, int mode, unsigned int len, uint32_t addr, uint32_t dup_addr, int flags)
+{
+  spim->pending_repeat_len = len - __PI_SPIM_CHUNK_LEN;
+  spim->pending_repeat_enqueue_len = len - __PI_SPIM_CHUNK_LEN;
+  spim->pending_repeat_addr = addr + (__PI_SPIM_CHUNK_LEN >> 3);
+  spim->pending_repeat_dup_addr = dup_addr + (__PI_SPIM_CHUNK_LEN >> 3);
+  spim->pending_repeat_device = device;
+  spim->pending_repeat_send = mode;
+  spim->pending_repeat_flags = flags;
+  spim->pending_repeat_slot = 0;
+}
 
-    plp_udma_enqueue(rx_base, (unsigned int)spim->pending_repeat_addr, size, UDMA_CHANNEL_CFG_EN | (2<<1));
-    plp_udma_enqueue(tx_base, (unsigned int)spim->udma_cmd, cmd_size*4, UDMA_CHANNEL_CFG_EN);
 
-    spim->pending_repeat_addr += size;
-  }
-#endif
+
+// Called on the EOT of each chunk but the last one. The chunk which was
+// queued behind is already running, the next one is queued behind it.
+void __rt_spi_handle_repeat(void *arg)
+{
+  int irq = rt_irq_disable();
+
+  pi_spim_t *spim = (pi_spim_t *)arg;
+  unsigned int len = spim->pending_repeat_len;
+
+  // Once this reaches 0, the running chunk is the last one and its EOT
+  // terminates the transfer as for small transfers.
+  spim->pending_repeat_len -= len > __PI_SPIM_CHUNK_LEN ? __PI_SPIM_CHUNK_LEN : len;
+
+  if (spim->pending_repeat_enqueue_len)
+    __pi_spim_repeat_enqueue(spim);
 
   rt_irq_restore(irq);
 }
@@ -331,7 +488,7 @@ void pi_spi_send_async(struct pi_device *device, void *data, size_t len, pi_spi_
   int qspi = (flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
   int cs_mode = (flags >> 0) & 0x3;
 
-  if (spim->pending_copy)
+  if (__pi_spim_wait(spim, spim_cs, task))
   {
     task->implem.data[0] = 0;
     task->implem.data[1] = (int)device;
@@ -339,35 +496,22 @@ void pi_spi_send_async(struct pi_device *device, void *data, size_t len, pi_spi_
     task->implem.data[3] = len;
     task->implem.data[4] = flags;
 
-    if (spim->waiting_first)
-      spim->waiting_last->implem.next = task;
-    else
-      spim->waiting_first = task;
-
-    spim->waiting_last = task;
-    task->implem.next = NULL;
-
     goto end;
   }
 
   unsigned int cmd_base = spim_cs->periph_base + ARCHI_SPIM_CMD_OFFSET;
   unsigned int channel_base = spim_cs->periph_base + UDMA_CHANNEL_TX_OFFSET;
-  int buffer_size = (len+7)/8;
+  int repeat = len > __PI_SPIM_CHUNK_LEN;
 
-  if (len > 8192*8)
+  if (repeat)
   {
-    spim->pending_repeat_len = len - 8192*8;
-    spim->pending_repeat_addr = (uint32_t)data + 8192;
-    spim->pending_repeat_base = spim_cs->periph_base;
-    spim->pending_repeat_device = device;
-    spim->pending_repeat_send = 1;
-    spim->pending_repeat_flags = flags;
-    len = 8192*8;
+    __pi_spim_repeat_start(spim, device, 1, len, (uint32_t)data, 0, flags);
+    len = __PI_SPIM_CHUNK_LEN;
   }
   
-  spim->pending_copy = task;
+  __pi_spim_start(spim, spim_cs, task, cs_mode == RT_SPIM_CS_KEEP);
 
-  int size = (len + 7) >> 3;
+  int buffer_size = (len+7)/8;
 
   // First enqueue the header with SPI config, cs, and send command.
   // The rest will be sent by the assembly code.
@@ -376,12 +520,15 @@ void pi_spi_send_async(struct pi_device *device, void *data, size_t len, pi_spi_
   spim->udma_cmd[0] = spim_cs->cfg;
   spim->udma_cmd[1] = SPI_CMD_SOT(spim_cs->cs);
   spim->udma_cmd[2] = SPI_CMD_TX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST);
-  spim->udma_cmd[3] = SPI_CMD_EOT(1, cs_mode == RT_SPIM_CS_KEEP);
+  spim->udma_cmd[3] = SPI_CMD_EOT(1, repeat || cs_mode == RT_SPIM_CS_KEEP);
 
   int cfg = UDMA_CHANNEL_CFG_SIZE_32 | UDMA_CHANNEL_CFG_EN;
   plp_udma_enqueue(cmd_base, (int)spim->udma_cmd, 4*4, cfg);
   plp_udma_enqueue(channel_base, (int)data, buffer_size, cfg);
 
+  if (repeat)
+    __pi_spim_repeat_enqueue(spim);
+
 end:
   rt_irq_restore(irq);
 }
@@ -409,7 +556,7 @@ void pi_spi_receive_async(struct pi_device *device, void *data, size_t len, pi_s
   int qspi = (flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
   int cs_mode = (flags >> 0) & 0x3;
 
-  if (spim->pending_copy)
+  if (__pi_spim_wait(spim, spim_cs, task))
   {
     task->implem.data[0] = 1;
     task->implem.data[1] = (int)device;
@@ -417,31 +564,20 @@ void pi_spi_receive_async(struct pi_device *device, void *data, size_t len, pi_s
     task->implem.data[3] = len;
     task->implem.data[4] = flags;
 
-    if (spim->waiting_first)
-      spim->waiting_last->implem.next = task;
-    else
-      spim->waiting_first = task;
-
-    spim->waiting_last = task;
-    task->implem.next = NULL;
-
     goto end;
   }
 
-  spim->pending_copy = task;
+  __pi_spim_start(spim, spim_cs, task, cs_mode == RT_SPIM_CS_KEEP);
 
   unsigned int rx_base = spim_cs->periph_base + UDMA_CHANNEL_RX_OFFSET;
   unsigned int cmd_base = spim_cs->periph_base + ARCHI_SPIM_CMD_OFFSET;
 
-  if (len > 8192*8)
+  int repeat = len > __PI_SPIM_CHUNK_LEN;
+
+  if (repeat)
   {
-    spim->pending_repeat_len = len - 8192*8;
-    spim->pending_repeat_addr = (uint32_t)data + 8192;
-    spim->pending_repeat_base = rx_base;
-    spim->pending_repeat_device = device;
-    spim->pending_repeat_send = 0;
-    spim->pending_repeat_flags = flags;
-    len = 8192*8;
+    __pi_spim_repeat_start(spim, device, 0, len, (uint32_t)data, 0, flags);
+    len = __PI_SPIM_CHUNK_LEN;
   }
   
   int size = (len + 7) >> 3;
@@ -449,12 +585,15 @@ void pi_spi_receive_async(struct pi_device *device, void *data, size_t len, pi_s
   spim->udma_cmd[0] = spim_cs->cfg;
   spim->udma_cmd[1] = SPI_CMD_SOT(spim_cs->cs);
   spim->udma_cmd[2] = SPI_CMD_RX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST);
-  spim->udma_cmd[3] = SPI_CMD_EOT(1, cs_mode == RT_SPIM_CS_KEEP);
+  spim->udma_cmd[3] = SPI_CMD_EOT(1, repeat || cs_mode == RT_SPIM_CS_KEEP);
 
-    int cfg = UDMA_CHANNEL_CFG_SIZE_32 | UDMA_CHANNEL_CFG_EN;
+  int cfg = UDMA_CHANNEL_CFG_SIZE_32 | UDMA_CHANNEL_CFG_EN;
   plp_udma_enqueue(rx_base, (unsigned int)data, size, cfg);
   plp_udma_enqueue(cmd_base, (unsigned int)spim->udma_cmd, 4*4, cfg);
 
+  if (repeat)
+    __pi_spim_repeat_enqueue(spim);
+
 end:
   rt_irq_restore(irq);
 }
@@ -479,7 +618,7 @@ void pi_spi_transfer_async(struct pi_device *device, void *tx_data, void *rx_dat
   pi_spim_t *spim = spim_cs->spim;
   int cs_mode = (flags >> 0) & 0x3;
 
-  if (spim->pending_copy)
+  if (__pi_spim_wait(spim, spim_cs, task))
   {
     task->implem.data[0] = 2;
     task->implem.data[1] = (int)device;
@@ -488,14 +627,6 @@ void pi_spi_transfer_async(struct pi_device *device, void *tx_data, void *rx_dat
     task->implem.data[4] = len;
     task->implem.data[5] = cs_mode;
 
-    if (spim->waiting_first)
-      spim->waiting_last->implem.next = task;
-    else
-      spim->waiting_first = task;
-
-    spim->waiting_last = task;
-    task->implem.next = NULL;
-
     goto end;
   }
 
@@ -505,19 +636,15 @@ void pi_spi_transfer_async(struct pi_device *device, void *tx_data, void *rx_dat
   unsigned int rx_base = spim_cs->periph_base + UDMA_CHANNEL_RX_OFFSET;
   unsigned int tx_base = spim_cs->periph_base + UDMA_CHANNEL_TX_OFFSET;
 
-  if (len > 8192*8)
+  int repeat = len > __PI_SPIM_CHUNK_LEN;
+
+  if (repeat)
   {
-    spim->pending_repeat_len = len - 8192*8;
-    spim->pending_repeat_base = tx_base;
-    spim->pending_repeat_addr = (uint32_t)rx_data + 8192;
-    spim->pending_repeat_dup_addr = (uint32_t)tx_data + 8192;
-    spim->pending_repeat_device = device;
-    spim->pending_repeat_send = 2;
-    spim->pending_repeat_flags = flags;
-    len = 8192*8;
+    __pi_spim_repeat_start(spim, device, 2, len, (uint32_t)rx_data, (uint32_t)tx_data, flags);
+    len = __PI_SPIM_CHUNK_LEN;
   }
   
-  spim->pending_copy = task;
+  __pi_spim_start(spim, spim_cs, task, cs_mode == RT_SPIM_CS_KEEP);
 
   // First enqueue the header with SPI config, cs, and send command.
   // The rest will be sent by the assembly code.
@@ -525,7 +652,7 @@ void pi_spi_transfer_async(struct pi_device *device, void *tx_data, void *rx_dat
   spim->udma_cmd[0] = spim_cs->cfg;
   spim->udma_cmd[1] = SPI_CMD_SOT(spim_cs->cs);
   spim->udma_cmd[2] = SPI_CMD_FUL(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, SPI_CMD_MSB_FIRST);
-  spim->udma_cmd[3] = SPI_CMD_EOT(1, cs_mode == RT_SPIM_CS_KEEP);
+  spim->udma_cmd[3] = SPI_CMD_EOT(1, repeat || cs_mode == RT_SPIM_CS_KEEP);
 
   int size = (len + 7) >> 3;
 
@@ -534,6 +661,9 @@ void pi_spi_transfer_async(struct pi_device *device, void *tx_data, void *rx_dat
   plp_udma_enqueue(rx_base, (unsigned int)rx_data, size, cfg);
   plp_udma_enqueue(tx_base, (unsigned int)tx_data, size, cfg);
 
+  if (repeat)
+    __pi_spim_repeat_enqueue(spim);
+
 end:
   rt_irq_restore(irq);
 }
@@ -545,14 +675,170 @@ void pi_spi_transfer(struct pi_device *device, void *tx_data, void *rx_data, siz
   pi_task_wait_on(&task);
 }
 
+void pi_spi_seq_init(pi_spi_seq_t *seq, struct pi_device *device)
+{
+  pi_spim_cs_t *spim_cs = (pi_spim_cs_t *)device->data;
+
+  seq->device = device;
+  seq->tx_size = 0;
+  seq->rx_size = 0;
+  seq->ended = 0;
+  seq->cs_keep = 0;
+  seq->cmds[0] = spim_cs->cfg;
+  seq->cmds[1] = SPI_CMD_SOT(spim_cs->cs);
+  seq->nb_cmds = 2;
+}
+
+
+
+static int __pi_spi_seq_push(pi_spi_seq_t *seq, uint32_t cmd)
+{
+  // Always keep one entry for the EOT command
+  if (seq->ended || seq->nb_cmds >= PI_SPI_SEQ_MAX_CMDS - 1)
+    return -1;
+
+  seq->cmds[seq->nb_cmds++] = cmd;
+
+  return 0;
+}
+
+
+
+int pi_spi_seq_cmd(pi_spi_seq_t *seq, uint16_t value, int bits, pi_spi_flags_e flags)
+{
+  int qspi = (flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
+  return __pi_spi_seq_push(seq, SPI_CMD_SEND_CMD(value, bits, qspi));
+}
+
+
+
+int pi_spi_seq_dummy(pi_spi_seq_t *seq, int cycles)
+{
+  return __pi_spi_seq_push(seq, SPI_CMD_DUMMY(cycles));
+}
+
+
+
+int pi_spi_seq_send(pi_spi_seq_t *seq, size_t len, pi_spi_flags_e flags)
+{
+  int qspi = (flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
+
+  // Sequences are not split, the data must fit a single uDMA transfer
+  if (seq->tx_size || len == 0 || len > 8192*8)
+    return -1;
+
+  if (__pi_spi_seq_push(seq, SPI_CMD_TX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST)))
+    return -1;
+
+  seq->tx_size = (len + 7) >> 3;
+
+  return 0;
+}
+
+
+
+int pi_spi_seq_receive(pi_spi_seq_t *seq, size_t len, pi_spi_flags_e flags)
+{
+  int qspi = (flags & (0x3 << 2)) == PI_SPI_LINES_QUAD;
+
+  if (seq->rx_size || len == 0 || len > 8192*8)
+    return -1;
+
+  if (__pi_spi_seq_push(seq, SPI_CMD_RX_DATA(len/32, SPI_CMD_1_WORD_PER_TRANSF, 32, qspi, SPI_CMD_MSB_FIRST)))
+    return -1;
+
+  seq->rx_size = (len + 7) >> 3;
+
+  return 0;
+}
+
+
+
+int pi_spi_seq_end(pi_spi_seq_t *seq, pi_spi_flags_e flags)
+{
+  int cs_mode = (flags >> 0) & 0x3;
+
+  if (seq->ended)
+    return -1;
+
+  seq->cmds[seq->nb_cmds++] = SPI_CMD_EOT(1, cs_mode == RT_SPIM_CS_KEEP);
+  seq->cs_keep = cs_mode == RT_SPIM_CS_KEEP;
+  seq->ended = 1;
+
+  return 0;
+}
+
+
+
+void pi_spi_seq_exec_async(pi_spi_seq_t *seq, void *tx_data, void *rx_data, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  __rt_task_init(task);
+
+  pi_spim_cs_t *spim_cs = (pi_spim_cs_t *)seq->device->data;
+  pi_spim_t *spim = spim_cs->spim;
+
+  if (__pi_spim_wait(spim, spim_cs, task))
+  {
+    task->implem.data[0] = 3;
+    task->implem.data[1] = (int)seq;
+    task->implem.data[2] = (int)tx_data;
+    task->implem.data[3] = (int)rx_data;
+
+    goto end;
+  }
+
+  __pi_spim_start(spim, spim_cs, task, seq->cs_keep);
+
+  unsigned int cmd_base = spim_cs->periph_base + ARCHI_SPIM_CMD_OFFSET;
+  unsigned int rx_base = spim_cs->periph_base + UDMA_CHANNEL_RX_OFFSET;
+  unsigned int tx_base = spim_cs->periph_base + UDMA_CHANNEL_TX_OFFSET;
+  int cfg = UDMA_CHANNEL_CFG_SIZE_32 | UDMA_CHANNEL_CFG_EN;
+
+  // The data buffers are enqueued first so that they are ready when the
+  // command stream reaches them. The whole sequence ends with the EOT event
+  // which notifies the task as for the other transfers.
+  if (seq->rx_size)
+    plp_udma_enqueue(rx_base, (unsigned int)rx_data, seq->rx_size, cfg);
+  if (seq->tx_size)
+    plp_udma_enqueue(tx_base, (unsigned int)tx_data, seq->tx_size, cfg);
+  plp_udma_enqueue(cmd_base, (unsigned int)seq->cmds, seq->nb_cmds*4, cfg);
+
+end:
+  rt_irq_restore(irq);
+}
+
+
+
+void pi_spi_seq_exec(pi_spi_seq_t *seq, void *tx_data, void *rx_data)
+{
+  pi_task_t task;
+  pi_spi_seq_exec_async(seq, tx_data, rx_data, pi_task_block(&task));
+  pi_task_wait_on(&task);
+}
+
+
+
 void __pi_handle_waiting_copy(pi_task_t *task)
 {
   if (task->implem.data[0] == 0)
     pi_spi_send_async((struct pi_device *)task->implem.data[1], (void *)task->implem.data[2], task->implem.data[3], task->implem.data[4], task);
   else if (task->implem.data[0] == 1)
     pi_spi_receive_async((struct pi_device *)task->implem.data[1], (void *)task->implem.data[2], task->implem.data[3], task->implem.data[4], task);
-  else
+  else if (task->implem.data[0] == 2)
     pi_spi_transfer_async((struct pi_device *)task->implem.data[1], (void *)task->implem.data[2], (void *)task->implem.data[3], task->implem.data[4], task->implem.data[5], task);
+  else
+    pi_spi_seq_exec_async((pi_spi_seq_t *)task->implem.data[1], (void *)task->implem.data[2], (void *)task->implem.data[3], task);
+}
+
+void pi_spi_priority_set(struct pi_device *device, int priority)
+{
+  int irq = rt_irq_disable();
+  pi_spim_cs_t *spim_cs = (pi_spim_cs_t *)device->data;
+  spim_cs->priority = priority;
+  __pi_spim_arbiter_update(spim_cs->spim);
+  rt_irq_restore(irq);
 }
 
 void pi_spi_conf_init(struct pi_spi_conf *conf)
@@ -573,6 +859,9 @@ static void __attribute__((constructor)) __rt_spim_init()
     __rt_spim[i].open_count = 0;
     __rt_spim[i].pending_copy = NULL;
     __rt_spim[i].waiting_first = NULL;
+    __rt_spim[i].cs_first = NULL;
+    __rt_spim[i].locked_cs = NULL;
+    __rt_spim[i].last_cs = NULL;
     __rt_spim[i].id = i;
     __rt_udma_channel_reg_data(UDMA_EVENT_ID(ARCHI_UDMA_SPIM_ID(0) + i), &__rt_spim[i]);
     __rt_udma_channel_reg_data(UDMA_EVENT_ID(ARCHI_UDMA_SPIM_ID(0) + i)+1, &__rt_spim[i]);
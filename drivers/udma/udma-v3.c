@@ -22,6 +22,10 @@
 
 RT_FC_TINY_DATA rt_udma_channel_t *__rt_udma_channels[ARCHI_NB_PERIPH*2];
 
+#ifdef __RT_USE_DMA_PROFILE
+rt_udma_channel_stats_t __rt_udma_stats[ARCHI_NB_PERIPH*2];
+#endif
+
 
 #ifndef __RT_UDMA_COPY_ASM
 
@@ -33,9 +37,14 @@ void __rt_udma_handle_copy(int event, void *arg)
   pi_task_t *pending_first = channel->waitings_first;
   channel->pendings[0] = pending_1;
 
+  // The transfer in slot 1 has been moved to slot 0 by the hardware, so slot 1
+  // is now free. Feed it immediately with the first waiting transfer so that
+  // the channel never stays idle while there are still transfers queued.
   if (pending_first)
   {
-    // TODO
+    channel->pendings[1] = pending_first;
+    channel->waitings_first = pending_first->implem.next;
+    plp_udma_enqueue(channel->base, pending_first->implem.data[0], pending_first->implem.data[1], pending_first->implem.data[2]);
   }
   else
   {
@@ -56,23 +65,31 @@ void __rt_udma_copy_enqueue(pi_task_t *task, int channel_id, rt_udma_channel_t *
 {
   unsigned int base = hal_udma_channel_base(channel_id);
 
+  // Keep the base so that the end-of-transfer handler can refill the channel
+  // from the waiting list without knowing the channel ID.
+  channel->base = base;
+
   // A UDMA channel has 2 slots, enqueue the copy to the UDMA if one of them is available, otherwise
   // put the transfer on hold.
   if (channel->pendings[0] == NULL)
   {
     channel->pendings[0] = task;
     plp_udma_enqueue(base, buffer, size, UDMA_CHANNEL_CFG_EN | cfg);
+    __rt_udma_profile(channel_id, size, 0);
   }
   else if (channel->pendings[1] == NULL)
   {
     channel->pendings[1] = task;
     plp_udma_enqueue(base, buffer, size, UDMA_CHANNEL_CFG_EN | cfg);
+    __rt_udma_profile(channel_id, size, 0);
   }
   else
   {
+    __rt_udma_profile(channel_id, size, 1);
+
     task->implem.data[0] = buffer;
     task->implem.data[1] = size;
-    task->implem.data[2] = cfg;
+    task->implem.data[2] = UDMA_CHANNEL_CFG_EN | cfg;
 
     if (channel->waitings_first == NULL)
       channel->waitings_first = task;
@@ -86,11 +103,39 @@ void __rt_udma_copy_enqueue(pi_task_t *task, int channel_id, rt_udma_channel_t *
 
 
 
+void pi_udma_stats_get(int channel_id, rt_udma_channel_stats_t *stats)
+{
+#ifdef __RT_USE_DMA_PROFILE
+  *stats = __rt_udma_stats[channel_id];
+#else
+  stats->bytes = 0;
+  stats->nb_transfers = 0;
+  stats->nb_queued = 0;
+#endif
+}
+
+
+
+void pi_udma_stats_reset()
+{
+#ifdef __RT_USE_DMA_PROFILE
+  for (int i=0; i<ARCHI_NB_PERIPH*2; i++)
+  {
+    __rt_udma_stats[i].bytes = 0;
+    __rt_udma_stats[i].nb_transfers = 0;
+    __rt_udma_stats[i].nb_queued = 0;
+  }
+#endif
+}
+
+
+
 void __rt_udma_channel_init(int channel_id, rt_udma_channel_t *channel)
 {
   channel->pendings[0] = NULL;
   channel->pendings[1] = NULL;
   channel->waitings_first = NULL;
+  channel->waitings_last = NULL;
   __rt_udma_channels[channel_id] = channel;
 }
 
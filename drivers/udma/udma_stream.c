@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+
+
+static inline int __rt_udma_stream_index(rt_udma_stream_t *stream, int index)
+{
+  return index >= stream->nb_buffers ? index - stream->nb_buffers : index;
+}
+
+
+
+// Called when all buffers are used and the hardware has nothing left to do.
+// The oldest filled buffer is taken back from the ready list and moved after
+// the armed ones. The acquired buffers are shifted by one to keep the ring
+// order, which is the order in which the consumer releases them.
+static void __rt_udma_stream_overrun(rt_udma_stream_t *stream)
+{
+  int dropped = __rt_udma_stream_index(stream, stream->first + stream->nb_acquired);
+  void *buffer = stream->buffers[dropped];
+
+  for (int i=stream->nb_acquired-1; i>=0; i--)
+  {
+    int index = __rt_udma_stream_index(stream, stream->first + i);
+    stream->buffers[__rt_udma_stream_index(stream, index + 1)] = stream->buffers[index];
+  }
+
+  stream->buffers[stream->first] = buffer;
+  stream->first = __rt_udma_stream_index(stream, stream->first + 1);
+  stream->nb_filled--;
+  stream->nb_overruns++;
+}
+
+
+
+static void __rt_udma_stream_arm(rt_udma_stream_t *stream)
+{
+  while (stream->nb_armed < 2)
+  {
+    int used = stream->nb_acquired + stream->nb_filled + stream->nb_armed;
+
+    if (used == stream->nb_buffers)
+    {
+      // Only drop data when the channel would otherwise stop, the consumer
+      // may still release a buffer before the armed one is full.
+      if (stream->nb_armed || stream->nb_filled == 0)
+        return;
+
+      __rt_udma_stream_overrun(stream);
+      used--;
+    }
+
+    int index = __rt_udma_stream_index(stream, stream->first + used);
+    plp_udma_enqueue(stream->base, (int)stream->buffers[index], stream->size, stream->cfg);
+    stream->nb_armed++;
+  }
+}
+
+
+
+static void __rt_udma_stream_give(rt_udma_stream_t *stream, pi_task_t *task)
+{
+  int index = __rt_udma_stream_index(stream, stream->first + stream->nb_acquired);
+
+  stream->nb_filled--;
+  stream->nb_acquired++;
+
+  task->implem.data[0] = 0;
+  task->implem.data[1] = (int)stream->buffers[index];
+  task->implem.data[2] = stream->size;
+}
+
+
+
+static void __rt_udma_stream_cancel(pi_task_t *task)
+{
+  task->implem.data[0] = -1;
+  task->implem.data[1] = 0;
+  task->implem.data[2] = 0;
+  __rt_event_enqueue(task);
+}
+
+
+
+void __rt_udma_stream_handle(rt_udma_stream_t *stream)
+{
+  // Can happen when the channel is flushed after the stream is stopped
+  if (stream->nb_armed == 0)
+    return;
+
+  // The oldest armed buffer is now full
+  stream->nb_armed--;
+  stream->nb_filled++;
+
+  pi_task_t *task = stream->waiting_first;
+  if (task)
+  {
+    stream->waiting_first = task->implem.next;
+    __rt_udma_stream_give(stream, task);
+    __rt_event_enqueue(task);
+  }
+
+  if (stream->running)
+    __rt_udma_stream_arm(stream);
+}
+
+
+
+int __rt_udma_stream_start(rt_udma_stream_t *stream, int channel_id, void **buffers, int nb_buffers, uint32_t size, uint32_t cfg)
+{
+  if (nb_buffers < 1 || nb_buffers > RT_UDMA_STREAM_MAX_BUFFERS)
+    return -1;
+
+  int irq = rt_irq_disable();
+
+  for (int i=0; i<nb_buffers; i++)
+  {
+    stream->buffers[i] = buffers[i];
+  }
+
+  stream->base = hal_udma_channel_base(channel_id);
+  stream->cfg = UDMA_CHANNEL_CFG_EN | cfg;
+  stream->size = size;
+  stream->waiting_first = NULL;
+  stream->nb_overruns = 0;
+  stream->nb_buffers = nb_buffers;
+  stream->first = 0;
+  stream->nb_acquired = 0;
+  stream->nb_filled = 0;
+  stream->nb_armed = 0;
+  stream->running = 1;
+
+  __rt_udma_stream_arm(stream);
+
+  rt_irq_restore(irq);
+
+  return 0;
+}
+
+
+
+void __rt_udma_stream_stop(rt_udma_stream_t *stream)
+{
+  int irq = rt_irq_disable();
+  stream->running = 0;
+  rt_irq_restore(irq);
+}
+
+
+
+void __rt_udma_stream_flush(rt_udma_stream_t *stream)
+{
+  int irq = rt_irq_disable();
+
+  stream->nb_armed = 0;
+
+  // The consumers waiting for a buffer would never get one, notify them
+  // with no buffer and an error
+  pi_task_t *task = stream->waiting_first;
+  while (task)
+  {
+    pi_task_t *next = task->implem.next;
+    __rt_udma_stream_cancel(task);
+    task = next;
+  }
+
+  stream->waiting_first = NULL;
+
+  rt_irq_restore(irq);
+}
+
+
+
+void __rt_udma_stream_acquire(rt_udma_stream_t *stream, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  if (stream->nb_filled)
+  {
+    __rt_udma_stream_give(stream, task);
+    __rt_event_enqueue(task);
+  }
+  else if (!stream->running && stream->nb_armed == 0)
+  {
+    __rt_udma_stream_cancel(task);
+  }
+  else
+  {
+    if (stream->waiting_first)
+      stream->waiting_last->implem.next = task;
+    else
+      stream->waiting_first = task;
+
+    task->implem.next = NULL;
+    stream->waiting_last = task;
+  }
+
+  rt_irq_restore(irq);
+}
+
+
+
+void __rt_udma_stream_release(rt_udma_stream_t *stream)
+{
+  int irq = rt_irq_disable();
+
+  if (stream->nb_acquired)
+  {
+    stream->nb_acquired--;
+    stream->first = __rt_udma_stream_index(stream, stream->first + 1);
+
+    if (stream->running)
+      __rt_udma_stream_arm(stream);
+  }
+
+  rt_irq_restore(irq);
+}
@@ -243,28 +243,125 @@ error:
 
 
 
-rt_file_t *rt_fs_open(rt_fs_t *fs, const char *file_name, int flags, rt_event_t *event)
+// Hash of the file names used by the index, this must be the same as the one
+// used by the tool generating the image (32 bits FNV-1a).
+static unsigned int __rt_fs_hash(const char *name)
 {
-  // No need to mask interrupts, as the file-system is read-only
-  // its structure cannot change
+  unsigned int hash = 2166136261U;
+  while (*name)
+  {
+    hash ^= (unsigned char)*name++;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
 
-  rt_trace(RT_TRACE_FS, "[FS] Opening file (name: %s)\n", file_name);
 
-  // Get information about the file system from the header
+// Images generated before the index are scanned linearly
+static rt_fs_desc_t *__rt_fs_lookup_linear(rt_fs_t *fs, const char *file_name)
+{
   unsigned int *fs_info = fs->fs_info;
   int nb_comps = *fs_info++;
 
-  // Find the file in the file-system
-  rt_fs_desc_t *desc = NULL;
-  int i;
-  for (i=0; i<nb_comps; i++) {
-    desc = (rt_fs_desc_t *)fs_info;
-    if (strcmp(desc->name, file_name) == 0) break;
+  for (int i=0; i<nb_comps; i++) {
+    rt_fs_desc_t *desc = (rt_fs_desc_t *)fs_info;
+    if (strcmp(desc->name, file_name) == 0) return desc;
     fs_info = (unsigned int *)((unsigned int)fs_info + sizeof(rt_fs_desc_t) + desc->path_size);
   }
 
+  return NULL;
+}
+
+
+
+// Since version 2, the header is followed by an index of the files so that
+// they are found without scanning all descriptors. The header keeps the
+// same beginning so that older runtimes can still scan it:
+//   - number of files
+//   - file descriptors
+//   - index, aligned on 4 bytes:
+//     - number of buckets, which is a power of 2
+//     - for each bucket plus one, the position in the entry table of the
+//       first entry of this bucket. The entries of a bucket go up to the
+//       first entry of the next one.
+//     - for each file, the offset in bytes from the beginning of the header
+//       of its descriptor, sorted by bucket
+//   - offset in bytes from the beginning of the header of the index, as the
+//     last word of the header
+// A file goes into the bucket given by the low bits of the hash of its name.
+static rt_fs_desc_t *__rt_fs_lookup_index(rt_fs_t *fs, const char *file_name)
+{
+  unsigned int *fs_info = fs->fs_info;
+  unsigned int fs_size = fs->fs_l2->fs_size;
+
+  // Do not trust a corrupted index, the descriptors can still be scanned.
+  // The index must fit before the last word of the header.
+  if (fs_size < 8)
+    goto linear;
+
+  unsigned int nb_words = fs_size / 4 - 1;
+  unsigned int nb_comps = fs_info[0];
+  unsigned int index_offset = fs_info[nb_words];
+
+  if ((index_offset & 3) || index_offset / 4 >= nb_words)
+    goto linear;
+
+  unsigned int *index = &fs_info[index_offset / 4];
+  unsigned int nb_buckets = index[0];
+  unsigned int remaining = nb_words - index_offset / 4 - 1;
+
+  // The bucket table has one more entry than the number of buckets and the
+  // entry table has one entry per file
+  if (nb_buckets == 0 || (nb_buckets & (nb_buckets - 1)) ||
+    nb_buckets >= remaining || nb_comps > remaining - nb_buckets - 1)
+    goto linear;
+
+  unsigned int *buckets = &index[1];
+  unsigned int *entries = &buckets[nb_buckets + 1];
+  unsigned int bucket = __rt_fs_hash(file_name) & (nb_buckets - 1);
+  unsigned int first = buckets[bucket];
+  unsigned int last = buckets[bucket+1];
+
+  if (first > last || last > nb_comps)
+    goto linear;
+
+  for (unsigned int i=first; i<last; i++)
+  {
+    unsigned int offset = entries[i];
+
+    if ((offset & 3) || offset >= fs_size || fs_size - offset < sizeof(rt_fs_desc_t))
+      goto linear;
+
+    rt_fs_desc_t *desc = (rt_fs_desc_t *)((unsigned int)fs_info + offset);
+    if (strcmp(desc->name, file_name) == 0)
+      return desc;
+  }
+
+  return NULL;
+
+linear:
+  return __rt_fs_lookup_linear(fs, file_name);
+}
+
+
+
+rt_file_t *rt_fs_open(rt_fs_t *fs, const char *file_name, int flags, rt_event_t *event)
+{
+  // No need to mask interrupts, as the file-system is read-only
+  // its structure cannot change
+
+  rt_trace(RT_TRACE_FS, "[FS] Opening file (name: %s)\n", file_name);
+
+  // Find the file in the file-system
+  rt_fs_desc_t *desc;
+  if (fs->fs_l2->fs_version == RT_FS_VERSION)
+    desc = __rt_fs_lookup_index(fs, file_name);
+  else
+    desc = __rt_fs_lookup_linear(fs, file_name);
+
   // Leave if the file is not found
-  if (i == nb_comps) goto error;
+  if (desc == NULL) goto error;
 
   // Now allocate the file descriptor and fills it
   rt_file_t *file = rt_alloc(RT_ALLOC_FC_DATA, sizeof(rt_file_t));
@@ -303,7 +400,7 @@ static int __rt_fs_read_from_cache(rt_file_t *file, unsigned int buffer, unsigne
 {
   rt_trace(RT_TRACE_FS, "[FS] Read from cache (buffer: 0x%x, addr: 0x%x, size: 0x%x)\n", buffer, addr, size);
 
-  memcpy((void *)buffer, &file->fs->cache[addr - file->fs->cache_addr], size);
+  __rt_memcpy_fast((void *)buffer, &file->fs->cache[addr - file->fs->cache_addr], size);
 
   return size;
 }
@@ -40,10 +40,52 @@
 typedef struct rt_spiflash_s {
   rt_flash_t header;
   rt_spim_t *spim;
+  rt_event_t *pending;
+  rt_event_t *read;
+  rt_event_t *waiting_first;
+  rt_event_t *waiting_last;
+  int step;
+  int backoff;
+  int backoff_max;
+  int chunk;
+  int suspended;
+  pi_task_t step_task;
+  pi_task_t cmd_task;
+  uint8_t cmd[4] __attribute__((aligned(4)));
+  uint32_t status;
 } rt_spiflash_t;
 
 #define CMD_BUFF_SIZE 16
 
+// Flash operations, stored with their parameters in the data of the event
+#define SPIFLASH_OP_READ    0
+#define SPIFLASH_OP_PROGRAM 1
+#define SPIFLASH_OP_ERASE   2
+
+// Steps of the state machine executing the program and erase operations.
+// Each step is executed once the SPI transfers of the previous one are done
+// or once the polling delay is over.
+#define SPIFLASH_STEP_CMD       0
+#define SPIFLASH_STEP_POLL      1
+#define SPIFLASH_STEP_CHECK     2
+#define SPIFLASH_STEP_READ_DONE 3
+
+#define SPIFLASH_PAGE_SIZE 256
+
+// The status register is first polled after this delay, which is then
+// doubled after each poll up to 8 times this delay.
+#define SPIFLASH_PROGRAM_POLL_US 50
+#define SPIFLASH_ERASE_POLL_US   500
+
+// Delay between polls while waiting for an erase to be suspended
+#define SPIFLASH_SUSPEND_POLL_US 20
+
+// The part can suspend an erase to execute reads
+#define SPIFLASH_HAS_ERASE_SUSPEND 1
+
+void __rt_spim_send_async(rt_spim_t *handle, void *data, size_t len, int qspi, rt_spim_cs_e cs_mode, rt_event_t *event);
+void __rt_spim_receive_async(rt_spim_t *handle, void *data, size_t len, int qspi, rt_spim_cs_e cs_mode, rt_event_t *event);
+
 typedef struct {
   unsigned int sot;
   unsigned int sendCmd;
@@ -65,26 +107,12 @@ static volatile RT_L2_DATA uint32_t __rt_spiflash_rcv_buffer;
 static void __rt_spiflash_free(rt_spiflash_t *flash)
 {
   if (flash != NULL) {
-    rt_free(RT_ALLOC_FC_DATA, (void *)flash, sizeof(rt_spiflash_t));
+    rt_free(RT_ALLOC_PERIPH, (void *)flash, sizeof(rt_spiflash_t));
   }
 }
 
 
 
-static void __rt_spiflash_send_and_rcv(rt_spiflash_t *flash, void *snd_buff, int snd_size, void *rcv_buff, int rcv_size)
-{
-#if 0
-  rt_event_t *event = __rt_wait_event_prepare_blocking();
-  rt_periph_copy_t *copy = &event->copy;
-  rt_periph_copy_init(copy, 0);
-  copy->event = event;
-  rt_periph_dual_copy_safe(copy, flash->channel, (unsigned int)snd_buff, snd_size, (int)rcv_buff, rcv_size, 2<<1);
-  __rt_wait_event(event);
-#endif
-}
-
-
-
 static void __rt_spiflash_send(rt_spiflash_t *flash, void *buff, int size)
 {
 #if 0
@@ -188,9 +216,15 @@ static rt_flash_t *__rt_spiflash_open(rt_dev_t *dev, rt_flash_conf_t *conf, rt_e
 
   rt_spiflash_t *flash = NULL;
 
-  flash = rt_alloc(RT_ALLOC_FC_DATA, sizeof(rt_spiflash_t));
+  // The command and status buffers of the structure are accessed by the uDMA
+  flash = rt_alloc(RT_ALLOC_PERIPH, sizeof(rt_spiflash_t));
   if (flash == NULL) goto error;
 
+  flash->pending = NULL;
+  flash->read = NULL;
+  flash->waiting_first = NULL;
+  flash->suspended = 0;
+
   rt_spim_conf_t spi_conf;
   rt_spim_conf_init(&spi_conf);
   spi_conf.max_baudrate = 1000000;
@@ -247,184 +281,318 @@ void __rt_spiflash_enqueue_callback();
 
 
 
-static void __rt_spiflash_read(rt_flash_t *_dev, void *data, void *addr, size_t size, rt_event_t *event)
-{
-  #if 0
-  rt_trace(RT_TRACE_FLASH, "[UDMA] Enqueueing SPI flash read (dev: %p, data: %p, addr: %p, size 0x%x, event: %p)\n", _dev, data, addr, size, event);
+static void __rt_spiflash_exec(rt_spiflash_t *flash);
 
-  int irq = rt_irq_disable();
+static void __rt_spiflash_step(void *arg);
 
-  rt_spiflash_t *flash = (rt_spiflash_t *)_dev;
 
-  rt_event_t *call_event = __rt_wait_event_prepare(event);
-  rt_periph_copy_t *copy = &call_event->copy;
-  int channel_id = flash->channel;
 
-  rt_periph_copy_init_ctrl(copy, RT_PERIPH_COPY_SPIFLASH);
+static inline rt_event_t *__rt_spiflash_next(rt_spiflash_t *flash, int step)
+{
+  flash->step = step;
+  pi_task_callback(&flash->step_task, __rt_spiflash_step, (void *)flash);
+  return &flash->step_task;
+}
 
-  rt_periph_channel_t *channel = __rt_periph_channel(channel_id);
-  unsigned int periph_base = hal_udma_periph_base(channel_id >> 1);
-  unsigned int tx_base = periph_base + UDMA_CHANNEL_TX_OFFSET;
-  unsigned int rx_base = periph_base + UDMA_CHANNEL_RX_OFFSET;
-  unsigned int tx_addr = (unsigned int)&flash_read;
-  unsigned int rx_addr = (int)data;
-  int tx_size = sizeof(flashRead_t);
-  int rx_size = size;
-  unsigned int flash_addr_cmd = SPI_CMD_SEND_ADDR_VALUE(((int)addr)<<8);
-  unsigned int flash_size_cmd = SPI_CMD_RX_DATA(size*8, 0, SPI_CMD_BYTE_ALIGN_ENA);
 
-  unsigned int cfg = (2<<1) | UDMA_CHANNEL_CFG_EN;
-  copy->event = call_event;
 
-  __rt_channel_push(channel, copy);
+// Sends the command byte followed by the 24 bits address
+static void __rt_spiflash_send_cmd_addr(rt_spiflash_t *flash, uint8_t cmd, uint32_t addr, rt_spim_cs_e cs_mode, rt_event_t *event)
+{
+  flash->cmd[0] = cmd;
+  flash->cmd[1] = addr >> 16;
+  flash->cmd[2] = addr >> 8;
+  flash->cmd[3] = addr;
+  __rt_spim_send_async(flash->spim, flash->cmd, 4*8, 0, cs_mode, event);
+}
 
-  if (likely(!channel->firstToEnqueue && !plp_udma_busy(tx_base)))
-  {
-    printf("Direct enqueue\n");
-    flash_read.addr = flash_addr_cmd;
-    flash_read.rxData = flash_size_cmd;
-
-    plp_udma_enqueue(rx_base, rx_addr, rx_size, cfg);
-    plp_udma_enqueue(tx_base, tx_addr, tx_size, cfg);
-  } else {
-    copy->size = tx_size;
-    copy->cfg = cfg;
-    copy->u.raw.val[0] = rx_addr;
-    copy->u.raw.val[1] = rx_size;
-    copy->u.raw.val[2] = flash_addr_cmd;
-    copy->u.raw.val[3] = flash_addr_cmd;
-    __rt_channel_enqueue(channel, copy, tx_addr, tx_size, cfg);
-  }
 
-__rt_wait_event_check(event, call_event);
 
-  rt_irq_restore(irq);
-#endif
+static void __rt_spiflash_send_cmd(rt_spiflash_t *flash, uint8_t cmd, rt_spim_cs_e cs_mode, rt_event_t *event)
+{
+  flash->cmd[0] = cmd;
+  __rt_spim_send_async(flash->spim, flash->cmd, 8, 0, cs_mode, event);
 }
 
 
-static uint32_t __rt_spiflash_send_cmd_and_rcv(rt_spiflash_t *flash, uint32_t cmd)
+
+// The first transfers of a command are not waited for, they are done before
+// the last one whose end executes the next step.
+static inline rt_event_t *__rt_spiflash_cmd_task(rt_spiflash_t *flash)
 {
-  int index = 0;
+  return pi_task_block(&flash->cmd_task);
+}
+
 
-  cmd_buffer[index++] = SPI_CMD_SOT       (0);
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (0x05, 8, 0);
-  cmd_buffer[index++] = SPI_CMD_DUMMY     (32);
-  cmd_buffer[index++] = SPI_CMD_RX_DATA   (8, 0, SPI_CMD_BYTE_ALIGN_DIS);
-  cmd_buffer[index++] = SPI_CMD_EOT       (0);
 
-  __rt_spiflash_rcv_buffer = 0;
+static void __rt_spiflash_read_exec(rt_spiflash_t *flash, rt_event_t *op)
+{
+  __rt_spiflash_send_cmd_addr(flash, 0x03, op->implem.data[2], RT_SPIM_CS_KEEP, __rt_spiflash_cmd_task(flash));
+  __rt_spim_receive_async(flash->spim, (void *)op->implem.data[1], op->implem.data[3]*8, 0, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_READ_DONE));
+}
 
-  __rt_spiflash_send_and_rcv(flash, cmd_buffer, index*4, (void *)&__rt_spiflash_rcv_buffer, 4);
 
-  return __rt_spiflash_rcv_buffer;
+
+static void __rt_spiflash_poll(rt_spiflash_t *flash)
+{
+  __rt_spiflash_send_cmd(flash, 0x05, RT_SPIM_CS_KEEP, __rt_spiflash_cmd_task(flash));
+  __rt_spim_receive_async(flash->spim, (void *)&flash->status, 8, 0, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_CHECK));
 }
 
 
 
-static void __rt_spiflash_send_cmd(rt_spiflash_t *flash, uint32_t cmd)
+static rt_event_t *__rt_spiflash_pop_read(rt_spiflash_t *flash)
 {
-  int index = 0;
+  rt_event_t *op = flash->waiting_first;
 
-  cmd_buffer[index++] = SPI_CMD_SOT       (0);
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (cmd, 8, 0);
-  cmd_buffer[index++] = SPI_CMD_EOT       (0);
+  if (op == NULL || op->implem.data[0] != SPIFLASH_OP_READ)
+    return NULL;
 
-  __rt_spiflash_send(flash, cmd_buffer, index*4);
+  flash->waiting_first = op->implem.next;
+  return op;
 }
 
 
 
-static uint32_t __rt_spiflash_read_sr1v(rt_spiflash_t *flash)
+static void __rt_spiflash_end(rt_spiflash_t *flash)
 {
-  uint32_t val =  __rt_spiflash_send_cmd_and_rcv(flash, 0x05);
+  rt_event_t *op = flash->pending;
+  flash->pending = NULL;
+  __rt_event_enqueue(op);
 
-  printf("Got sr1v %lx\n", val);
+  op = flash->waiting_first;
+  if (op)
+  {
+    flash->waiting_first = op->implem.next;
+    flash->pending = op;
+    __rt_spiflash_exec(flash);
+  }
+}
 
-  return __rt_spiflash_rcv_buffer;
+
+
+static void __rt_spiflash_check(rt_spiflash_t *flash)
+{
+  rt_event_t *op = flash->pending;
+
+  if (flash->status & 1)
+  {
+    // Still busy. Suspend the erase if a read is waiting so that it does not
+    // have to wait for the end of the erase.
+    if (SPIFLASH_HAS_ERASE_SUSPEND && !flash->suspended && op->implem.data[0] == SPIFLASH_OP_ERASE)
+    {
+      flash->read = __rt_spiflash_pop_read(flash);
+      if (flash->read)
+      {
+        flash->suspended = 1;
+        __rt_spiflash_send_cmd(flash, 0x75, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_POLL));
+        return;
+      }
+    }
+
+    // Otherwise check again later, the FC is free in the meantime
+    if (flash->suspended)
+    {
+      rt_event_push_delayed(__rt_spiflash_next(flash, SPIFLASH_STEP_POLL), SPIFLASH_SUSPEND_POLL_US);
+    }
+    else
+    {
+      rt_event_push_delayed(__rt_spiflash_next(flash, SPIFLASH_STEP_POLL), flash->backoff);
+      if (flash->backoff < flash->backoff_max)
+        flash->backoff <<= 1;
+    }
+    return;
+  }
+
+  if (flash->suspended)
+  {
+    // The erase is suspended, the read can be executed
+    __rt_spiflash_read_exec(flash, flash->read);
+    return;
+  }
+
+  if (op->implem.data[0] == SPIFLASH_OP_PROGRAM)
+  {
+    op->implem.data[1] += flash->chunk;
+    op->implem.data[2] += flash->chunk;
+    op->implem.data[3] -= flash->chunk;
+
+    if (op->implem.data[3])
+    {
+      __rt_spiflash_exec(flash);
+      return;
+    }
+  }
+
+  __rt_spiflash_end(flash);
 }
 
 
 
-static uint32_t __rt_spiflash_read_sr2v(rt_spiflash_t *flash)
+static void __rt_spiflash_read_done(rt_spiflash_t *flash)
 {
-  uint32_t val =  __rt_spiflash_send_cmd_and_rcv(flash, 0x07);
+  if (!flash->suspended)
+  {
+    __rt_spiflash_end(flash);
+    return;
+  }
 
-  printf("Got sr12v %lx\n", val);
+  __rt_event_enqueue(flash->read);
 
-  return __rt_spiflash_rcv_buffer;
+  // Execute all the reads which are waiting before resuming the erase
+  flash->read = __rt_spiflash_pop_read(flash);
+  if (flash->read)
+  {
+    __rt_spiflash_read_exec(flash, flash->read);
+    return;
+  }
+
+  flash->suspended = 0;
+  flash->backoff = SPIFLASH_ERASE_POLL_US;
+  __rt_spiflash_send_cmd(flash, 0x7A, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_POLL));
 }
 
 
 
-static void __rt_spiflash_program(rt_flash_t *_dev, void *data, void *addr, size_t size, rt_event_t *event)
+static void __rt_spiflash_step(void *arg)
 {
+  rt_spiflash_t *flash = (rt_spiflash_t *)arg;
+  rt_event_t *op = flash->pending;
+
   int irq = rt_irq_disable();
 
-  rt_spiflash_t *flash = (rt_spiflash_t *)_dev;
+  switch (flash->step)
+  {
+    case SPIFLASH_STEP_CMD:
+    {
+      uint32_t addr = op->implem.data[2];
+
+      if (op->implem.data[0] == SPIFLASH_OP_PROGRAM)
+      {
+        // Program at most until the end of the page
+        int chunk = SPIFLASH_PAGE_SIZE - (addr & (SPIFLASH_PAGE_SIZE - 1));
+        if (chunk > (int)op->implem.data[3])
+          chunk = op->implem.data[3];
+        flash->chunk = chunk;
+
+        __rt_spiflash_send_cmd_addr(flash, 0x02, addr, RT_SPIM_CS_KEEP, __rt_spiflash_cmd_task(flash));
+        __rt_spim_send_async(flash->spim, (void *)op->implem.data[1], chunk*8, 0, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_POLL));
+      }
+      else
+      {
+        __rt_spiflash_send_cmd_addr(flash, 0x20, addr, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_POLL));
+      }
+      break;
+    }
+
+    case SPIFLASH_STEP_POLL:
+      __rt_spiflash_poll(flash);
+      break;
+
+    case SPIFLASH_STEP_CHECK:
+      __rt_spiflash_check(flash);
+      break;
+
+    case SPIFLASH_STEP_READ_DONE:
+      __rt_spiflash_read_done(flash);
+      break;
+  }
 
-  __rt_spiflash_send_cmd(flash, 0x06);
+  rt_irq_restore(irq);
+}
 
-  int index = 0;
-  cmd_buffer[index++] = SPI_CMD_EOT       (0),
-  cmd_buffer[index++] = SPI_CMD_SOT       (0);
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (0x02, 8, 0);
-  cmd_buffer[index++] = SPI_CMD_SEND_ADDR (24, 0);
-  cmd_buffer[index++] = ((int)addr)<<8;
-  cmd_buffer[index++] = SPI_CMD_TX_DATA   (size*8, 0, SPI_CMD_BYTE_ALIGN_ENA);
 
-  __rt_spiflash_send(flash, cmd_buffer, index*4);
 
-  __rt_spiflash_send(flash, data, size);
+// Starts the pending operation. Program and erase operations start with a
+// write enable, whose end executes the command.
+static void __rt_spiflash_exec(rt_spiflash_t *flash)
+{
+  rt_event_t *op = flash->pending;
+
+  if (op->implem.data[0] == SPIFLASH_OP_READ)
+  {
+    __rt_spiflash_read_exec(flash, op);
+    return;
+  }
+
+  int poll_us = op->implem.data[0] == SPIFLASH_OP_PROGRAM ? SPIFLASH_PROGRAM_POLL_US : SPIFLASH_ERASE_POLL_US;
+  flash->backoff = poll_us;
+  flash->backoff_max = poll_us << 3;
+
+  __rt_spiflash_send_cmd(flash, 0x06, RT_SPIM_CS_AUTO, __rt_spiflash_next(flash, SPIFLASH_STEP_CMD));
+}
 
-  index = 0;
-  cmd_buffer[index++] = SPI_CMD_EOT       (0),
 
-  __rt_spiflash_send(flash, cmd_buffer, index*4);
 
-  while ((__rt_spiflash_read_sr2v(flash) & 1) == 1)
+// Operations are executed one after the other, except reads which can be
+// executed while an erase is suspended.
+static void __rt_spiflash_enqueue(rt_spiflash_t *flash, rt_event_t *op, int type, uint32_t data, uint32_t addr, uint32_t size)
+{
+  op->implem.data[0] = type;
+  op->implem.data[1] = data;
+  op->implem.data[2] = addr;
+  op->implem.data[3] = size;
+
+  if (flash->pending)
   {
-    rt_time_wait_us(100);
+    if (flash->waiting_first)
+      flash->waiting_last->implem.next = op;
+    else
+      flash->waiting_first = op;
+    flash->waiting_last = op;
+    op->implem.next = NULL;
   }
+  else
+  {
+    flash->pending = op;
+    __rt_spiflash_exec(flash);
+  }
+}
+
+
+
+static void __rt_spiflash_read(rt_flash_t *_dev, void *data, void *addr, size_t size, rt_event_t *event)
+{
+  rt_trace(RT_TRACE_FLASH, "[UDMA] Enqueueing SPI flash read (dev: %p, data: %p, addr: %p, size 0x%x, event: %p)\n", _dev, data, addr, size, event);
+
+  int irq = rt_irq_disable();
+
+  rt_spiflash_t *flash = (rt_spiflash_t *)_dev;
+  rt_event_t *call_event = __rt_wait_event_prepare(event);
+
+  __rt_spiflash_enqueue(flash, call_event, SPIFLASH_OP_READ, (uint32_t)data, (uint32_t)addr, size);
+
+  __rt_wait_event_check(event, call_event);
 
   rt_irq_restore(irq);
 }
 
-static void __rt_spiflash_erase_sector(rt_flash_t *_dev, void *data, rt_event_t *event)
+
+
+static void __rt_spiflash_program(rt_flash_t *_dev, void *data, void *addr, size_t size, rt_event_t *event)
 {
   int irq = rt_irq_disable();
 
   rt_spiflash_t *flash = (rt_spiflash_t *)_dev;
+  rt_event_t *call_event = __rt_wait_event_prepare(event);
 
-  int index = 0;
-  cmd_buffer[index++] = SPI_CMD_SOT       (0),
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (0x06, 8, 0),    //write enable 
-  cmd_buffer[index++] = SPI_CMD_EOT       (0),
-  cmd_buffer[index++] = SPI_CMD_SOT       (0);
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (0x20, 8, 0);
-  cmd_buffer[index++] = SPI_CMD_SEND_ADDR (24, 0);
-  cmd_buffer[index++] = ((int)data)<<8;
-  cmd_buffer[index++] = SPI_CMD_EOT       (0);
+  __rt_spiflash_enqueue(flash, call_event, SPIFLASH_OP_PROGRAM, (uint32_t)data, (uint32_t)addr, size);
 
-  __rt_spiflash_send(flash, cmd_buffer, index*4);
+  __rt_wait_event_check(event, call_event);
 
-  while ((__rt_spiflash_read_sr1v(flash) & 1) == 1)
-  {
-    rt_time_wait_us(100);
-  }
+  rt_irq_restore(irq);
+}
 
-  index = 0;
-  cmd_buffer[index++] = SPI_CMD_SOT       (0);
-  cmd_buffer[index++] = SPI_CMD_SEND_CMD  (0xD0, 8, 0);
-  cmd_buffer[index++] = SPI_CMD_SEND_ADDR (24, 0);
-  cmd_buffer[index++] = ((int)data)<<8;
-  cmd_buffer[index++] = SPI_CMD_EOT       (0);
+static void __rt_spiflash_erase_sector(rt_flash_t *_dev, void *data, rt_event_t *event)
+{
+  int irq = rt_irq_disable();
 
-  __rt_spiflash_send(flash, cmd_buffer, index*4);
+  rt_spiflash_t *flash = (rt_spiflash_t *)_dev;
+  rt_event_t *call_event = __rt_wait_event_prepare(event);
 
-  uint32_t err = __rt_spiflash_read_sr2v(flash);
+  __rt_spiflash_enqueue(flash, call_event, SPIFLASH_OP_ERASE, 0, (uint32_t)data, 0);
 
-  printf("GOT err %ld\n", err);
+  __rt_wait_event_check(event, call_event);
 
   rt_irq_restore(irq);
 }
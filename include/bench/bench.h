@@ -96,6 +96,58 @@ typedef struct _testcase_t {
 
 int bench_cluster_exec(int cid, int (*entry)());
 
+/**
+ * @brief Measures the fabric controller cycles needed to offload an empty
+ * function to the cluster, with normal cluster tasks and with a persistent
+ * cluster worker, and prints the average for both.
+ * @param[in] cid the cluster to use.
+ * @param[in] nb_iter the number of offloads to average on.
+ */
+int bench_cluster_offload(int cid, int nb_iter);
+
+/**
+ * @brief Executes an irregular set of single core tasks with the cluster
+ * task scheduler, first through the queue shared by all cores, then through
+ * the per-core work-stealing deques with all tasks pushed by one core, and
+ * finally with the tasks pushed by the cores executing them, and prints the
+ * time and the amount of work done by each core for each of them.
+ * @param[in] cid the cluster to use.
+ * @param[in] nb_tasks the number of tasks, at most 64.
+ */
+int bench_task_irregular(int cid, int nb_tasks);
+
+/**
+ * @brief Gathers small blocks spread in L2 into the cluster memory, first
+ * with one DMA command per block, all pushed before a single wait, and then
+ * with a single scatter-gather list, and prints the cluster cycles needed for
+ * both.
+ * @param[in] cid the cluster to use.
+ * @param[in] nb_blocks the number of blocks, at most 64.
+ * @param[in] block_size the size in bytes of each block, at most 256.
+ */
+int bench_dma_gather(int cid, int nb_blocks, int block_size);
+
+/**
+ * @brief Reads 1MB from an SPI device with reads of buffer_size bytes,
+ * while the fabric controller keeps executing a unit of work, and prints
+ * the time and the percentage of this time the fabric controller was
+ * available for the work. Reads bigger than 8KB are split by the driver.
+ * @param[in] itf the SPI interface.
+ * @param[in] cs the chip select of the device.
+ * @param[in] baudrate the SPI frequency.
+ * @param[in] buffer_size the size in bytes of each read.
+ */
+int bench_spi_read(int itf, int cs, int baudrate, int buffer_size);
+
+/**
+ * @brief Checks the fabric controller copy service, synchronous and
+ * asynchronous, for all the source and destination alignments and for small
+ * sizes including 0, and prints the number of errors. A copy must not modify
+ * any byte around the destination.
+ * @return the number of errors.
+ */
+int bench_fc_memcpy_check(void);
+
 /**
  * @brief Disables the printf ouput of the function print_summary() and
  * run_suite(). These functions are required to run the bench suite and write
@@ -24,6 +24,8 @@ typedef struct {
   int open_count;
   uint32_t base;
   rt_udma_channel_t channel;
+  rt_udma_stream_t stream;
+  pi_buf_t stream_bufs[RT_UDMA_STREAM_MAX_BUFFERS];
 } rt_cpi_t;
 
 #endif
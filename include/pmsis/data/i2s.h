@@ -20,18 +20,14 @@
 #ifndef LANGUAGE_ASSEMBLY
 
 #include "pmsis/task.h"
+#include "pmsis/data/udma.h"
 
 typedef struct {
-    uint8_t reenqueue;
     uint8_t clk;
     uint8_t open_count;
-    uint8_t current_buffer;
-    uint8_t current_read_buffer;
-    uint8_t nb_ready_buffer;
     uint8_t channel;
     struct pi_i2s_conf conf;
-    pi_task_t *waiting_first;
-    pi_task_t *waiting_last;
+    rt_udma_stream_t stream;
     int i2s_freq;
     uint32_t udma_cfg;
 } pos_i2s_t;
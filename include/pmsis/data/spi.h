@@ -38,8 +38,29 @@ typedef struct {
   unsigned int pending_repeat_flags;
   uint32_t buffer;
   struct pi_device *pending_repeat_device;
+  unsigned int pending_repeat_enqueue_len;
+  unsigned int pending_repeat_cmd[2][3];
+  unsigned int pending_repeat_slot;
+  void *cs_first;
+  void *locked_cs;
+  void *last_cs;
 } pi_spim_t;
 
+#define PI_SPI_SEQ_MAX_CMDS 16
+
+// Prepared sequence of SPI operations, compiled into a single uDMA command
+// stream which can be replayed with different data buffers. It must be in L2
+// as the command stream is read by the uDMA.
+typedef struct {
+  struct pi_device *device;
+  uint32_t cmds[PI_SPI_SEQ_MAX_CMDS];
+  uint32_t tx_size;
+  uint32_t rx_size;
+  uint8_t nb_cmds;
+  uint8_t ended;
+  uint8_t cs_keep;
+} pi_spi_seq_t;
+
 #endif
 
 #define PI_SPIM_T_PENDING_COPY      0
@@ -25,13 +25,42 @@ typedef struct {
   pi_task_t *pendings[2];
   pi_task_t *waitings_first;
   pi_task_t *waitings_last;
+  uint32_t base;
 } rt_udma_channel_t;
 
+#define RT_UDMA_STREAM_MAX_BUFFERS 8
+
+// Continuous reception on a uDMA channel through a ring of buffers.
+// Buffers move in ring order from the hardware (armed) to the ready list
+// (filled) and then to the consumer (acquired) before being armed again.
+typedef struct {
+  void *buffers[RT_UDMA_STREAM_MAX_BUFFERS];
+  uint32_t base;
+  uint32_t cfg;
+  uint32_t size;
+  pi_task_t *waiting_first;
+  pi_task_t *waiting_last;
+  uint32_t nb_overruns;
+  uint8_t nb_buffers;
+  uint8_t first;
+  uint8_t nb_acquired;
+  uint8_t nb_filled;
+  uint8_t nb_armed;
+  uint8_t running;
+} rt_udma_stream_t;
+
+typedef struct {
+  uint32_t bytes;
+  uint32_t nb_transfers;
+  uint32_t nb_queued;
+} rt_udma_channel_stats_t;
+
 #endif
 
 #define RT_UDMA_CHANNEL_T_PENDINGS_0     0
 #define RT_UDMA_CHANNEL_T_PENDINGS_1     4
 #define RT_UDMA_CHANNEL_T_PENDINGS_FIRST 8
 #define RT_UDMA_CHANNEL_T_PENDINGS_LAST  12
+#define RT_UDMA_CHANNEL_T_BASE           16
 
 #endif
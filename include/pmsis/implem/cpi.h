@@ -23,6 +23,40 @@
 #include "pmsis/data/cpi.h"
 #include "archi/udma/cpi/udma_cpi_v1.h"
 
+// Continuous capture into a ring of nb_buffers buffers of size bytes. While
+// the stream is running, the channel cannot be used with pi_cpi_capture.
+int pi_cpi_stream_start(struct pi_device *device, void **buffers, int nb_buffers, int32_t size);
+
+void pi_cpi_stream_stop(struct pi_device *device);
+
+// Gets the next filled buffer, the task is notified once it is available and
+// pi_cpi_stream_status returns it. Buffers must be released in the same
+// order. If the stream is stopped before a buffer is available, the task is
+// notified and pi_cpi_stream_status returns NULL.
+void pi_cpi_stream_acquire_async(struct pi_device *device, pi_task_t *task);
+
+void pi_cpi_stream_release(struct pi_device *device);
+
+static inline void *pi_cpi_stream_status(pi_task_t *task)
+{
+  return (void *)task->implem.data[1];
+}
+
+// Same as pi_cpi_stream_status but returns the frame as a shared buffer,
+// or NULL if the stream was stopped. The caller owns one reference, and the
+// frame goes back to the stream when the last reference is released with
+// pi_buf_unref, instead of pi_cpi_stream_release. Frames released out of
+// order go back to the stream once the older ones are released too.
+pi_buf_t *pi_cpi_stream_buf_status(struct pi_device *device, pi_task_t *task);
+
+// Returns the number of buffers overwritten because they were not released
+// in time since the stream was started.
+static inline uint32_t pi_cpi_stream_overruns_get(struct pi_device *device)
+{
+  rt_cpi_t *cpi = (rt_cpi_t *)device->data;
+  return cpi->stream.nb_overruns;
+}
+
 static inline void pi_cpi_control_start(struct pi_device *device)
 {
   rt_cpi_t *cpi = (rt_cpi_t *)device->data;
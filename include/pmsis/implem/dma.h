@@ -20,6 +20,7 @@
 #include "pmsis/cluster/dma/cl_dma.h"
 #include "pmsis.h"
 #include "hal/pulp.h"
+#include "rt/rt_tile.h"
 
 struct pi_cl_dma_cmd_s
 {
@@ -36,6 +37,162 @@ struct pi_cl_dma_cmd_s
 extern RT_L1_TINY_DATA pi_cl_dma_cmd_t *__rt_dma_first_pending;
 extern RT_L1_TINY_DATA pi_cl_dma_cmd_t *__rt_dma_last_pending;
 
+// Maximum size of each command pushed for large transfers
+#define PI_CL_DMA_LARGE_BURST_SIZE  0x8000
+
+// Number of commands pushed at once for large transfers. At most 2 batches,
+// each one using a single DMA counter, are in flight for a transfer.
+#define PI_CL_DMA_LARGE_BATCH       4
+
+typedef struct pi_cl_dma_large_s
+{
+  uint32_t ext;
+  uint32_t loc;
+  uint32_t size;
+  uint32_t stride;
+  uint32_t length;
+  uint32_t line_pos;
+  pi_cl_dma_dir_e dir;
+  int ids[2];
+  int current;
+} pi_cl_dma_large_t;
+
+// Maximum number of dimensions of N-D transfers
+#define PI_CL_DMA_MAX_DIMS 4
+
+typedef struct pi_cl_dma_nd_s
+{
+  uint32_t ext;
+  uint32_t loc;
+  int nb_dims;
+  pi_cl_dma_dir_e dir;
+  uint32_t size[PI_CL_DMA_MAX_DIMS];
+  uint32_t stride[PI_CL_DMA_MAX_DIMS];
+} pi_cl_dma_nd_t;
+
+typedef struct pi_cl_dma_sg_entry_s
+{
+  uint32_t ext;
+  uint32_t loc;
+  uint32_t size;
+  uint32_t stride;
+  uint32_t length;
+} pi_cl_dma_sg_entry_t;
+
+// Maximum number of buffers used by a DMA pipeline
+#define PI_CL_DMA_PIPE_MAX_BUFFERS 3
+
+typedef struct pi_cl_dma_tile_s
+{
+  uint32_t ext;
+  uint32_t size;
+  uint32_t stride;
+  uint32_t length;
+} pi_cl_dma_tile_t;
+
+typedef struct pi_cl_dma_pipe_s
+{
+  pi_cl_dma_tile_t *in;
+  pi_cl_dma_tile_t *out;
+  int nb_tiles;
+  void *buffer;
+  uint32_t buffer_size;
+  void (*compute)(void *in, void *out, int tile, void *arg);
+  void *arg;
+  int nb_cores;
+
+  // Statistics, in cycles
+  unsigned int in_wait_cycles;
+  unsigned int out_wait_cycles;
+  unsigned int compute_cycles;
+  int nb_buffers;
+
+  // Current tile, read by all cores during compute
+  void *current_in;
+  void *current_out;
+  int current_tile;
+} pi_cl_dma_pipe_t;
+
+static inline int __cl_dma_lock()
+{
+#if MCHAN_VERSION >= 7
+  eu_mutex_lock_from_id(0);
+  return 0;
+#else
+  return rt_irq_disable();
+#endif
+}
+
+static inline void __cl_dma_unlock(int lock)
+{
+#if MCHAN_VERSION >= 7
+  eu_mutex_unlock_from_id(0);
+#else
+  rt_irq_restore(lock);
+#endif
+}
+
+typedef struct pi_cl_dma_stats_s
+{
+  uint32_t bytes;
+  uint32_t nb_cmds;
+  uint32_t wait_cycles;
+  uint32_t alloc_cycles;
+} pi_cl_dma_stats_t;
+
+/** \brief Get the DMA statistics of a cluster core.
+ *
+ * The statistics are only updated when the runtime is compiled with
+ * __RT_USE_DMA_PROFILE, otherwise they are always 0. They count the bytes
+ * and commands pushed by the core, the cycles it spent waiting for the end
+ * of transfers and the cycles it spent allocating DMA counters, which shows
+ * when all counters are in use. Cycles are read from the cluster timer, which
+ * must be running, e.g. through pi_perf_start.
+ *
+ * \param core_id The core whose statistics are returned.
+ * \param stats   Filled with the statistics.
+ */
+void pi_cl_dma_stats_get(int core_id, pi_cl_dma_stats_t *stats);
+
+/** \brief Reset the DMA statistics of all cluster cores.
+ */
+void pi_cl_dma_stats_reset();
+
+#ifdef __RT_USE_DMA_PROFILE
+
+extern RT_L1_DATA pi_cl_dma_stats_t __rt_dma_stats[ARCHI_CLUSTER_NB_PE];
+
+static inline uint32_t __cl_dma_profile_time()
+{
+  return pi_perf_cl_read(PI_PERF_CYCLES);
+}
+
+static inline void __cl_dma_profile_cmd(uint32_t size)
+{
+  pi_cl_dma_stats_t *stats = &__rt_dma_stats[rt_core_id()];
+  stats->bytes += size;
+  stats->nb_cmds++;
+}
+
+static inline void __cl_dma_profile_wait(uint32_t start)
+{
+  __rt_dma_stats[rt_core_id()].wait_cycles += __cl_dma_profile_time() - start;
+}
+
+static inline void __cl_dma_profile_alloc(uint32_t start)
+{
+  __rt_dma_stats[rt_core_id()].alloc_cycles += __cl_dma_profile_time() - start;
+}
+
+#else
+
+static inline uint32_t __cl_dma_profile_time() { return 0; }
+static inline void __cl_dma_profile_cmd(uint32_t size) {}
+static inline void __cl_dma_profile_wait(uint32_t start) {}
+static inline void __cl_dma_profile_alloc(uint32_t start) {}
+
+#endif
+
 static inline void __cl_dma_memcpy(unsigned int ext, unsigned int loc, unsigned short size, pi_cl_dma_dir_e dir, int merge, pi_cl_dma_cmd_t *copy)
 {
 #ifdef __RT_USE_PROFILE
@@ -50,7 +207,10 @@ static inline void __cl_dma_memcpy(unsigned int ext, unsigned int loc, unsigned
 #endif
   
   int id = -1;
+  uint32_t start = __cl_dma_profile_time();
   if (!merge) id = plp_dma_counter_alloc();
+  __cl_dma_profile_alloc(start);
+  __cl_dma_profile_cmd(size);
   unsigned int cmd = plp_dma_getCmd(dir, size, PLP_DMA_1D, PLP_DMA_TRIG_EVT, PLP_DMA_NO_TRIG_IRQ, PLP_DMA_SHARED);
   // Prevent the compiler from pushing the transfer before all previous
   // stores are done
@@ -84,7 +244,10 @@ static inline void __cl_dma_memcpy_2d(unsigned int ext, unsigned int loc, unsign
   eu_mutex_lock_from_id(0);
   
   int id = -1;
+  uint32_t start = __cl_dma_profile_time();
   if (!merge) id = plp_dma_counter_alloc();
+  __cl_dma_profile_alloc(start);
+  __cl_dma_profile_cmd(size);
 
   {
     unsigned int cmd = plp_dma_getCmd(dir, size, PLP_DMA_2D, PLP_DMA_TRIG_EVT, PLP_DMA_NO_TRIG_IRQ, PLP_DMA_SHARED);
@@ -117,6 +280,8 @@ static inline void __cl_dma_memcpy_2d(unsigned int ext, unsigned int loc, unsign
   
   int id = -1;
 
+  __cl_dma_profile_cmd(size);
+
   if (stride < (1<<15))
   {
     if (!merge) id = plp_dma_counter_alloc();
@@ -192,6 +357,7 @@ static inline void __cl_dma_wait(pi_cl_dma_cmd_t *copy)
 #endif
 
   int counter = copy->id;
+  uint32_t start = __cl_dma_profile_time();
 
   eu_mutex_lock_from_id(0);
 
@@ -204,6 +370,8 @@ static inline void __cl_dma_wait(pi_cl_dma_cmd_t *copy)
   plp_dma_counter_free(counter);
 
   eu_mutex_unlock_from_id(0);
+
+  __cl_dma_profile_wait(start);
   
 #ifdef __RT_USE_PROFILE
   gv_vcd_dump_trace(trace, 1);
@@ -218,6 +386,8 @@ static inline void __cl_dma_wait(pi_cl_dma_cmd_t *copy)
   int trace = __rt_pe_trace[rt_core_id()];
   gv_vcd_dump_trace(trace, 5);
 #endif
+  uint32_t start = __cl_dma_profile_time();
+
   if (copy->length == 0)
   {
     int irq = rt_irq_disable();
@@ -237,6 +407,8 @@ static inline void __cl_dma_wait(pi_cl_dma_cmd_t *copy)
     while(*(volatile uint32_t *)&copy->ext_addr != 0)
       eu_evt_maskWaitAndClr(1<<RT_DMA_EVENT);
   }
+
+  __cl_dma_profile_wait(start);
   
 #ifdef __RT_USE_PROFILE
   gv_vcd_dump_trace(trace, 1);
@@ -283,4 +455,152 @@ static inline void pi_cl_dma_cmd_wait(pi_cl_dma_cmd_t *cmd)
   __cl_dma_wait((pi_cl_dma_cmd_t *)cmd);
 }
 
+/** \brief 1D DMA transfer with no size limit.
+ *
+ * Same as pi_cl_dma_cmd but the size can be bigger than what the DMA can
+ * transfer with one command. The transfer is split into commands of at most
+ * PI_CL_DMA_LARGE_BURST_SIZE bytes. Only 2 DMA counters and 2 batches of
+ * PI_CL_DMA_LARGE_BATCH commands are used at the same time, the rest is
+ * pushed from pi_cl_dma_large_wait as soon as a batch is finished.
+ *
+ * \param ext  Address in the external memory.
+ * \param loc  Address in the cluster memory.
+ * \param size Number of bytes to be transfered.
+ * \param dir  Direction of the transfer.
+ * \param copy Transfer structure, used to wait for the completion.
+ */
+void pi_cl_dma_memcpy_large(uint32_t ext, uint32_t loc, uint32_t size, pi_cl_dma_dir_e dir, pi_cl_dma_large_t *copy);
+
+/** \brief 2D DMA transfer with no size limit.
+ *
+ * Same as pi_cl_dma_cmd_2d but the total size can be bigger than what the DMA
+ * can transfer with one command. Lines are grouped into 2D commands of at
+ * most PI_CL_DMA_LARGE_BURST_SIZE bytes. Lines which are too long or
+ * strides which are too big for the DMA are transfered with 1D commands.
+ *
+ * \param ext    Address in the external memory.
+ * \param loc    Address in the cluster memory.
+ * \param size   Total number of bytes to be transfered.
+ * \param stride Number of bytes between 2 lines in the external memory.
+ * \param length Number of bytes of each line.
+ * \param dir    Direction of the transfer.
+ * \param copy   Transfer structure, used to wait for the completion.
+ */
+void pi_cl_dma_memcpy_2d_large(uint32_t ext, uint32_t loc, uint32_t size, uint32_t stride, uint32_t length, pi_cl_dma_dir_e dir, pi_cl_dma_large_t *copy);
+
+/** \brief Wait for the end of a large DMA transfer.
+ *
+ * This also pushes the remaining commands of the transfer, so it must be
+ * called from the core which started it.
+ *
+ * \param copy Transfer structure.
+ */
+void pi_cl_dma_large_wait(pi_cl_dma_large_t *copy);
+
+/** \brief N-D DMA transfer.
+ *
+ * Transfers a tensor of up to PI_CL_DMA_MAX_DIMS dimensions between the
+ * external memory, where each dimension has its own stride, and the cluster
+ * memory, where the tensor is contiguous.
+ * size[0] is the number of contiguous bytes of the innermost dimension and
+ * stride[0] is ignored. For the other dimensions, size[i] is the number of
+ * elements and stride[i] the number of bytes between 2 elements in the
+ * external memory.
+ * Dimensions which are contiguous in the external memory are merged, and
+ * the 2 innermost remaining ones are transfered with 2D commands. All the
+ * commands are pushed at once under the DMA lock and attached to a single
+ * counter, so that the whole transfer can be waited with
+ * pi_cl_dma_cmd_wait.
+ *
+ * \param desc The transfer descriptor. It can be reused as soon as this call returns.
+ * \param cmd  The command structure used to wait for the completion.
+ */
+void pi_cl_dma_cmd_nd(pi_cl_dma_nd_t *desc, pi_cl_dma_cmd_t *cmd);
+
+/** \brief 3D DMA transfer.
+ *
+ * Same as pi_cl_dma_cmd_nd with 3 dimensions, which is typically used to
+ * move a [C][H][W] tile.
+ *
+ * \param ext      Address in the external memory.
+ * \param loc      Address in the cluster memory.
+ * \param length   Number of contiguous bytes of each line.
+ * \param stride   Number of bytes between 2 lines in the external memory.
+ * \param nb_lines Number of lines of each 2D plane.
+ * \param stride_2d Number of bytes between 2 planes in the external memory.
+ * \param nb_2d    Number of 2D planes.
+ * \param dir      Direction of the transfer.
+ * \param cmd      The command structure used to wait for the completion.
+ */
+static inline void pi_cl_dma_cmd_3d(uint32_t ext, uint32_t loc, uint32_t length, uint32_t stride, uint32_t nb_lines, uint32_t stride_2d, uint32_t nb_2d, pi_cl_dma_dir_e dir, pi_cl_dma_cmd_t *cmd)
+{
+  pi_cl_dma_nd_t desc;
+  desc.ext = ext;
+  desc.loc = loc;
+  desc.nb_dims = 3;
+  desc.dir = dir;
+  desc.size[0] = length;
+  desc.size[1] = nb_lines;
+  desc.stride[1] = stride;
+  desc.size[2] = nb_2d;
+  desc.stride[2] = stride_2d;
+  pi_cl_dma_cmd_nd(&desc, cmd);
+}
+
+/** \brief Scatter-gather DMA transfer.
+ *
+ * Transfers a list of blocks with a single DMA lock acquisition and a
+ * single DMA counter, so that the whole list can be waited with
+ * pi_cl_dma_cmd_wait. Each entry is a 1D block of size bytes if stride is
+ * 0, or a 2D block of lines of length bytes otherwise. Entries bigger than
+ * what the DMA can transfer at once are split.
+ *
+ * \param entries    The list of blocks. It can be reused as soon as this call returns.
+ * \param nb_entries The number of blocks.
+ * \param dir        Direction of the transfers.
+ * \param cmd        The command structure used to wait for the completion.
+ */
+void pi_cl_dma_cmd_sg(pi_cl_dma_sg_entry_t *entries, int nb_entries, pi_cl_dma_dir_e dir, pi_cl_dma_cmd_t *cmd);
+
+
+/** \brief Run a DMA pipeline.
+ *
+ * Processes a sequence of tiles by copying each input tile from the external
+ * memory to the cluster memory, calling the compute callback on all cores
+ * and copying the output tile back to the external memory. The cluster
+ * buffer is divided into up to PI_CL_DMA_PIPE_MAX_BUFFERS slots, each one
+ * big enough for the biggest input and output tiles, so that the input of
+ * the next tiles and the output of the previous ones are transfered while
+ * the current one is computed.
+ * A tile descriptor is a 1D transfer if stride is 0, or a 2D transfer of
+ * lines of length bytes otherwise. Tiles bigger than what the DMA can
+ * transfer with one command are split. in or out can be NULL if the kernel
+ * has no input or no output.
+ * The number of cycles spent waiting for inputs, for outputs and computing
+ * are stored in the pipeline structure, and the perf counters must have been
+ * configured and started with PI_PERF_CYCLES to get them.
+ * Must be called from the cluster master core.
+ *
+ * \param pipe The pipeline structure, which must have been filled with the tiles, buffer, compute callback and number of cores.
+ * \return 0 if the operation is successfull, or -1 if the buffer is too small for one slot.
+ */
+int pi_cl_dma_pipe_run(pi_cl_dma_pipe_t *pipe);
+
+/** \brief Prepare the tiles of a DMA pipeline from a tile plan.
+ *
+ * Fills the input and output tile descriptors of a 2D plan computed with
+ * pi_tile_plan for one input and one output. Input tiles include the plan
+ * halo, clipped on the tensor boundaries. The pipeline can then be run with
+ * a buffer of plan->footprint bytes and plan->depth buffers.
+ *
+ * \param pipe      The pipeline structure, whose tiles fields are set by this call.
+ * \param plan      The tile plan.
+ * \param in        Address of the input tensor in the external memory.
+ * \param out       Address of the output tensor in the external memory.
+ * \param in_tiles  Array of at least plan->nb_tiles[0]*plan->nb_tiles[1] input descriptors.
+ * \param out_tiles Array of at least plan->nb_tiles[0]*plan->nb_tiles[1] output descriptors.
+ * \return 0 if the operation is successfull, or -1 if the plan is not a 2D plan for one input and one output, or if plan->depth is bigger than PI_CL_DMA_PIPE_MAX_BUFFERS.
+ */
+int pi_cl_dma_pipe_plan(pi_cl_dma_pipe_t *pipe, pi_tile_plan_t *plan, uint32_t in, uint32_t out, pi_cl_dma_tile_t *in_tiles, pi_cl_dma_tile_t *out_tiles);
+
 #endif
\ No newline at end of file
@@ -14,21 +14,11 @@
  * limitations under the License.
  */
 
-/* 
- * Authors: Germain Haugou, GreenWaves Technologies (germain.haugou@greenwaves-technologies.com)
- */
-
-#include "pmsis/data/i2s.h"
-#include "rt/rt_data.h"
-#include "archi/pulp.h"
-
-  // x8: callback arg, x9: channel, x10:event, x11,x12:temp
-  .global __pos_i2s_handle_copy_asm
-__pos_i2s_handle_copy_asm:
+#ifndef __PMSIS_IMPLEM_I2S_H__
+#define __PMSIS_IMPLEM_I2S_H__
 
-  mv        x10, x8
-  la        x12, __pos_i2s_handle_copy
-  la        x9, udma_event_handler_end
-  j         __rt_call_external_c_function
+// Returns the number of blocks which were overwritten because the
+// application did not read them in time since the last start.
+uint32_t pi_i2s_overruns_get(struct pi_device *device);
 
-	
\ No newline at end of file
+#endif
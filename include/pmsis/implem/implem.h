@@ -23,6 +23,8 @@
 #include "pmsis/implem/pwm.h"
 #include "pmsis/implem/perf.h"
 #include "pmsis/implem/cpi.h"
+#include "pmsis/implem/i2s.h"
+#include "pmsis/implem/spi.h"
 #include "pmsis/implem/uart.h"
 #ifdef MCHAN_VERSION
 #include "pmsis/implem/dma.h"
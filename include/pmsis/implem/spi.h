@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018 GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PMSIS_IMPLEM_SPI_H__
+#define __PMSIS_IMPLEM_SPI_H__
+
+#ifdef ARCHI_UDMA_HAS_SPIM
+
+#include "pmsis/drivers/spi.h"
+#include "pmsis/data/spi.h"
+
+// SPI command sequences.
+// A sequence is built once with the configuration of the device, then
+// each operation is appended (command, dummy cycles, one send and one
+// receive at most) and the sequence is closed with pi_spi_seq_end.
+// It is then executed as a single transfer, with only the data buffers
+// given at each execution, and completes with a single task.
+// The sequence must be built again if the device is reconfigured with
+// pi_spi_ioctl. The functions appending operations return -1 if the
+// sequence is full, already ended or already has an operation of this
+// kind, and 0 otherwise.
+
+void pi_spi_seq_init(pi_spi_seq_t *seq, struct pi_device *device);
+
+// Appends a command of up to 16 bits sent from the command stream
+int pi_spi_seq_cmd(pi_spi_seq_t *seq, uint16_t value, int bits, pi_spi_flags_e flags);
+
+int pi_spi_seq_dummy(pi_spi_seq_t *seq, int cycles);
+
+// Appends a send or receive of len bits, whose buffer is given at execution
+int pi_spi_seq_send(pi_spi_seq_t *seq, size_t len, pi_spi_flags_e flags);
+
+int pi_spi_seq_receive(pi_spi_seq_t *seq, size_t len, pi_spi_flags_e flags);
+
+// Closes the sequence, the chip select is kept low if flags has PI_SPI_CS_KEEP
+int pi_spi_seq_end(pi_spi_seq_t *seq, pi_spi_flags_e flags);
+
+void pi_spi_seq_exec_async(pi_spi_seq_t *seq, void *tx_data, void *rx_data, pi_task_t *task);
+
+void pi_spi_seq_exec(pi_spi_seq_t *seq, void *tx_data, void *rx_data);
+
+// Devices on the same bus have their own queue of transfers. When the bus
+// is free, the waiting transfer of the device with the highest priority is
+// executed first, devices with the same priority being served in turn.
+// A device which has been skipped several times is served anyway.
+// Transfers keeping the chip select active lock the bus for the device
+// until one of its transfers releases the chip select.
+// The default priority is 0.
+void pi_spi_priority_set(struct pi_device *device, int priority);
+
+#endif
+
+#endif
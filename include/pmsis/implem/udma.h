@@ -23,6 +23,63 @@ extern RT_FC_TINY_DATA rt_udma_channel_t *__rt_udma_channels[ARCHI_NB_PERIPH*2];
 
 extern void __rt_udma_channel_init(int channel_id, rt_udma_channel_t *channel);
 
+// Generic per-channel transfer queue. Drivers register __rt_udma_handle_copy
+// as the channel callback and enqueue their transfers with
+// __rt_udma_copy_enqueue. The 2 hardware slots are used first, the other
+// transfers are kept in the channel software queue and the end-of-transfer
+// handler pushes the next one to the hardware before notifying the finished
+// transfer, so that the channel keeps streaming as long as transfers are
+// queued.
 extern void __rt_udma_copy_enqueue(pi_task_t *task, int channel_id, rt_udma_channel_t *channel, uint32_t buffer, uint32_t size, uint32_t cfg);
 
+// Generic streaming on a uDMA channel. Once started, the stream keeps the 2
+// hardware slots armed with the free buffers of the ring, and the consumer
+// gets the filled buffers with __rt_udma_stream_acquire (buffer in
+// data[1] and size in data[2] of the task) and gives them back in the same
+// order with __rt_udma_stream_release. When the consumer is late and the
+// channel is about to stop, the oldest filled buffer is overwritten and the
+// overrun counter incremented.
+// __rt_udma_handle_stream must be registered as the channel callback with
+// the stream as argument.
+extern void __rt_udma_handle_stream();
+
+int __rt_udma_stream_start(rt_udma_stream_t *stream, int channel_id, void **buffers, int nb_buffers, uint32_t size, uint32_t cfg);
+
+void __rt_udma_stream_stop(rt_udma_stream_t *stream);
+
+// Must be called once the channel has been cleared after the stream is
+// stopped. The pending acquires, and the ones done afterwards while no
+// buffer is filled, are notified with a NULL buffer and -1 in data[0].
+void __rt_udma_stream_flush(rt_udma_stream_t *stream);
+
+void __rt_udma_stream_acquire(rt_udma_stream_t *stream, pi_task_t *task);
+
+void __rt_udma_stream_release(rt_udma_stream_t *stream);
+
+// Returns the statistics of a uDMA channel. They count the bytes and the
+// transfers enqueued, and how many transfers had to wait in the software
+// queue because both hardware slots were busy. They are only updated when
+// the runtime is compiled with __RT_USE_DMA_PROFILE.
+void pi_udma_stats_get(int channel_id, rt_udma_channel_stats_t *stats);
+
+void pi_udma_stats_reset();
+
+#ifdef __RT_USE_DMA_PROFILE
+
+extern rt_udma_channel_stats_t __rt_udma_stats[ARCHI_NB_PERIPH*2];
+
+static inline void __rt_udma_profile(int channel_id, uint32_t size, int queued)
+{
+  rt_udma_channel_stats_t *stats = &__rt_udma_stats[channel_id];
+  stats->bytes += size;
+  stats->nb_transfers++;
+  stats->nb_queued += queued;
+}
+
+#else
+
+static inline void __rt_udma_profile(int channel_id, uint32_t size, int queued) {}
+
+#endif
+
 #endif
\ No newline at end of file
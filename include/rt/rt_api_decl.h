@@ -74,5 +74,9 @@
 #include "rt/rt_bridge.h"
 #include "rt/rt_eeprom.h"
 #include "rt/rt_task.h"
+#include "rt/rt_tile.h"
+#include "rt/rt_memcpy.h"
+#include "rt/rt_buf.h"
+#include "rt/rt_prefetch.h"
 
 #endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RT_RT_BUF_H__
+#define __RT_RT_BUF_H__
+
+/**        
+ * @ingroup groupKernel        
+ */
+
+/**        
+ * @defgroup Buf Shared buffers
+ *
+ * Reference-counted buffer descriptors which can be passed from one driver
+ * to another without copying the data, for example a frame filled by the
+ * camera, then processed by the cluster and sent on SPI.
+ * Each user takes a reference for as long as it accesses the data, and the
+ * buffer goes back to its owner when the last reference is released.
+ * References are taken and released from the fabric controller. Work
+ * offloaded to the cluster or to a driver keeps its reference until its
+ * termination task is executed, see pi_buf_unref_task.
+ * Buffers can also be owned by a driver, like the frames of a camera
+ * stream, which gets them back when their last reference is released.
+ */
+
+/**        
+ * @addtogroup Buf
+ * @{        
+ */
+
+/**@{*/
+
+/** \brief Create a pool of buffers.
+ *
+ * The descriptors and the data of all buffers are allocated in the
+ * specified memory level.
+ *
+ * \param pool      The pool structure. It must be kept alive until the pool is closed.
+ * \param flags     The memory where the buffers are allocated.
+ * \param nb_bufs   Number of buffers in the pool.
+ * \param size      Size in bytes of each buffer.
+ * \return 0 if the operation is successfull, or -1 if there was not enough memory.
+ */
+int pi_buf_pool_init(pi_buf_pool_t *pool, rt_alloc_e flags, int nb_bufs, uint32_t size);
+
+
+
+/** \brief Free a pool of buffers.
+ *
+ * All buffers must have been released.
+ *
+ * \param pool      The pool structure.
+ */
+void pi_buf_pool_deinit(pi_buf_pool_t *pool);
+
+
+
+/** \brief Get a buffer from a pool.
+ *
+ * The buffer is returned with one reference owned by the caller and with
+ * its length set to the buffer size.
+ *
+ * \param pool      The pool structure.
+ * \return The buffer, or NULL if all buffers are in use.
+ */
+pi_buf_t *pi_buf_get(pi_buf_pool_t *pool);
+
+
+
+/** \brief Get a buffer from a pool asynchronously.
+ *
+ * If all buffers are in use, the task is notified as soon as one is
+ * released. The buffer is then retrieved with pi_buf_get_status.
+ *
+ * \param pool      The pool structure.
+ * \param task      The task used to notify when the buffer is available.
+ */
+void pi_buf_get_async(pi_buf_pool_t *pool, pi_task_t *task);
+
+
+
+/** \brief Allocate a standalone buffer.
+ *
+ * The descriptor and the data are allocated together and freed when the
+ * last reference is released.
+ *
+ * \param flags     The memory where the buffer is allocated.
+ * \param size      Size in bytes of the buffer.
+ * \return The buffer with one reference owned by the caller, or NULL if there was not enough memory.
+ */
+pi_buf_t *pi_buf_alloc(rt_alloc_e flags, uint32_t size);
+
+
+
+/** \brief Initialize a buffer owned by a driver.
+ *
+ * This is used by drivers which produce buffers from their own memory. The
+ * buffer is returned with one reference. When the last reference is
+ * released, the release callback is called instead of giving the buffer
+ * back to a pool, and the driver can then reuse the data.
+ *
+ * \param buf       The buffer descriptor.
+ * \param addr      Address of the data.
+ * \param size      Size in bytes of the data.
+ * \param release   Function called when the last reference is released.
+ * \param arg       Argument given to the release function.
+ */
+void pi_buf_init(pi_buf_t *buf, void *addr, uint32_t size, void (*release)(pi_buf_t *buf, void *arg), void *arg);
+
+
+
+/** \brief Take a reference on a buffer.
+ *
+ * \param buf       The buffer.
+ * \return The buffer, to allow chaining.
+ */
+static inline pi_buf_t *pi_buf_ref(pi_buf_t *buf);
+
+
+
+/** \brief Release a reference on a buffer.
+ *
+ * The buffer goes back to its pool or to the driver owning it, or is freed,
+ * when this was the last reference.
+ *
+ * \param buf       The buffer.
+ */
+void pi_buf_unref(pi_buf_t *buf);
+
+
+
+/** \brief Initialize a task releasing a buffer reference.
+ *
+ * The returned task can be given as termination task of an asynchronous
+ * operation, like pi_cluster_send_task_to_cl_async or pi_spi_send_async,
+ * so that the reference is held until the operation is over.
+ * The reference must have been taken before the operation is started.
+ *
+ * \param buf       The buffer.
+ * \param task      The task structure.
+ * \return The task.
+ */
+static inline pi_task_t *pi_buf_unref_task(pi_buf_t *buf, pi_task_t *task);
+
+
+
+/** \brief Get the buffer returned by pi_buf_get_async.
+ *
+ * \param task      The task given to pi_buf_get_async.
+ * \return The buffer.
+ */
+static inline pi_buf_t *pi_buf_get_status(pi_task_t *task);
+
+
+
+//!@}
+
+/**        
+ * @} end of Buf group        
+ */
+
+
+
+/// @cond IMPLEM
+
+static inline pi_buf_t *pi_buf_ref(pi_buf_t *buf)
+{
+  int irq = rt_irq_disable();
+  buf->refcount++;
+  rt_irq_restore(irq);
+  return buf;
+}
+
+static inline pi_task_t *pi_buf_unref_task(pi_buf_t *buf, pi_task_t *task)
+{
+  return pi_task_callback(task, (void (*)(void *))pi_buf_unref, (void *)buf);
+}
+
+static inline pi_buf_t *pi_buf_get_status(pi_task_t *task)
+{
+  return (pi_buf_t *)task->implem.data[0];
+}
+
+/// @endcond
+
+#endif
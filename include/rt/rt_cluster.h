@@ -163,6 +163,133 @@ void rt_cluster_notif_deinit(rt_notif_t *notif);
 
 
 
+/** \brief Start a persistent cluster worker.
+ *
+ * A worker is a cluster task which stays active on the cluster and keeps the
+ * team of cores parked in the event unit with their stacks already bound.
+ * Functions can then be offloaded to it by only posting a function pointer and
+ * an argument, which removes the stack setup, core mask computation and
+ * dispatch done for each normal cluster task.
+ * While the worker is active, it occupies the cluster and other cluster tasks
+ * will only be executed once it is stopped.
+ * Can only be called from fabric controller.
+ *
+ * \param device     The cluster device, which must already be opened.
+ * \param worker     A pointer to the worker structure. It must be kept alive until the worker is stopped.
+ * \param nb_cores   Number of cores forked for each offloaded function. Can be 0 to select the maximum number of cores.
+ * \param stack_size Stack size of the master core. Can be 0 to select the default one.
+ * \param slave_stack_size Stack size of the slave cores. Can be 0 to select the default one.
+ * \return 0 if the operation is successfull, or -1 if it failed.
+ */
+int pi_cluster_worker_start(struct pi_device *device, pi_cluster_worker_t *worker, int nb_cores, int stack_size, int slave_stack_size);
+
+
+
+/** \brief Offload a function to a persistent cluster worker.
+ *
+ * The function is executed by all the cores of the worker, as with a team
+ * fork, and the task is pushed once all of them have returned.
+ * Up to RT_CLUSTER_WORKER_QUEUE_SIZE functions can be pending at the same time.
+ * If the queue is full, this call executes the fabric controller scheduler until
+ * a slot is released by the cluster.
+ * Can only be called from fabric controller.
+ *
+ * \param worker  A pointer to the worker structure.
+ * \param entry   The function to be executed on the cluster.
+ * \param arg     The argument of the function.
+ * \param task    The task used to notify the end of the execution.
+ */
+void pi_cluster_worker_send_async(pi_cluster_worker_t *worker, void (*entry)(void *), void *arg, pi_task_t *task);
+
+
+
+/** \brief Offload a function to a persistent cluster worker and wait for its completion.
+ *
+ * Same as pi_cluster_worker_send_async but blocks until the function has
+ * returned on all cores.
+ * Can only be called from fabric controller.
+ *
+ * \param worker  A pointer to the worker structure.
+ * \param entry   The function to be executed on the cluster.
+ * \param arg     The argument of the function.
+ */
+void pi_cluster_worker_send(pi_cluster_worker_t *worker, void (*entry)(void *), void *arg);
+
+
+
+/** \brief Stop a persistent cluster worker.
+ *
+ * The functions already posted are executed before the worker leaves the
+ * cluster. This call blocks until the worker has left and its resources are
+ * freed, after which normal cluster tasks can be sent again.
+ * Can only be called from fabric controller.
+ *
+ * \param worker  A pointer to the worker structure.
+ */
+void pi_cluster_worker_stop(pi_cluster_worker_t *worker);
+
+
+
+/** \brief Reserve cluster task stacks.
+ *
+ * Allocates in the cluster memory the stacks used by the cluster tasks which
+ * are sent without stacks. Any task whose stacks fit in the reserved area then
+ * uses it directly, whatever its stack sizes, so that no allocation is done
+ * when sending it. Tasks which do not fit use a small cache of stacks, which
+ * is indexed by size and keeps the most recently used ones. Stacks which are
+ * replaced while tasks are executing on the cluster are only freed once the
+ * cluster is idle.
+ * The reservation is kept when the cluster is power-gated while idle, the
+ * stacks are then allocated again when it is resumed. It is lost when the
+ * cluster is closed.
+ * Can only be called from fabric controller.
+ *
+ * \param device     The cluster device, which must already be opened.
+ * \param stack_size Stack size of the master core.
+ * \param slave_stack_size Stack size of the slave cores. Can be 0 to use the master one.
+ * \param nb_cores   Number of cores. Can be 0 to select the maximum number of cores.
+ * \return 0 if the operation is successfull, or -1 if it failed.
+ */
+int pi_cluster_stacks_reserve(struct pi_device *device, int stack_size, int slave_stack_size, int nb_cores);
+
+
+
+/** \brief Configure the cluster idle power-gating.
+ *
+ * When a timeout is set, the runtime powers down the cluster once no task has
+ * been executing on it during this amount of time. The next task sent to
+ * the cluster mounts it again before being enqueued, so that this is
+ * transparent for the application, apart from the mount latency.
+ * The cluster memory is not retained while the cluster is powered down, thus
+ * the L1 allocator and the stacks are reinitialized at each resume, apart
+ * from the reserved stacks, and the application must not keep data in L1
+ * between tasks.
+ * The idle time is checked periodically, so the cluster can stay powered up
+ * slightly longer than the timeout.
+ * Can only be called from fabric controller.
+ *
+ * \param device     The cluster device, which must already be opened.
+ * \param timeout_us Idle time in microseconds after which the cluster is powered down, or 0 to keep it always powered up.
+ */
+void pi_cluster_idle_timeout_set(struct pi_device *device, int timeout_us);
+
+
+
+/** \brief Get cluster mount statistics.
+ *
+ * Returns the number of times the cluster was mounted, either when it was
+ * opened or resumed after being power-gated, and the total time spent
+ * doing it.
+ * Can only be called from fabric controller.
+ *
+ * \param device        The cluster device.
+ * \param nb_mounts     Filled with the number of mounts.
+ * \param mount_time_us Filled with the accumulated mount time in microseconds.
+ */
+void pi_cluster_mount_stats(struct pi_device *device, unsigned int *nb_mounts, unsigned int *mount_time_us);
+
+
+
 //!@}
 
 /**        
@@ -226,6 +353,16 @@ static inline rt_event_sched_t *__rt_cluster_sched_get()
 // into the scheduler like a normal event
 void __rt_cluster_push_fc_event(rt_event_t *event);
 
+// Mounts again a cluster which was power-gated after being idle
+int __rt_cluster_resume(rt_fc_cluster_data_t *cluster);
+
+// Notifies the idle power-gating that a task was sent to the cluster
+void __rt_cluster_activity(rt_fc_cluster_data_t *cluster);
+
+// Notifies the idle power-gating that a task which does not return to the
+// cluster master loop, and thus does not push a tagged end event, is over
+void __rt_cluster_activity_end(rt_fc_cluster_data_t *cluster);
+
 // This function will push an event from cluster to FC and the event callback
 // will be executed directly from within the interrupt handler
 static inline void __rt_cluster_push_fc_irq_event(rt_event_t *event)
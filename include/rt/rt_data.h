@@ -107,6 +107,14 @@ typedef void (*rt_error_callback_t)(void *arg, rt_event_t *event, int error, voi
 #define RT_FORK_EVT 0
 #endif
 
+// Number of stack blocks kept allocated in L1 for cluster tasks, in addition
+// to the reserved one
+#define RT_CLUSTER_STACKS_CACHE_SIZE 2
+
+// Number of tasks which can be queued in each per-core task deque
+#define RT_TASK_DEQUE_SIZE_LOG2 3
+#define RT_TASK_DEQUE_SIZE      (1<<RT_TASK_DEQUE_SIZE_LOG2)
+
 #ifndef LANGUAGE_ASSEMBLY
 
 #include <stddef.h>
@@ -207,6 +215,31 @@ typedef struct {
   rt_alloc_chunk_extern_t *first_free;
 } rt_extern_alloc_t;
 
+struct pi_buf_pool_s;
+
+typedef struct pi_buf_s {
+  void *addr;
+  uint32_t size;
+  uint32_t length;
+  int refcount;
+  struct pi_buf_pool_s *pool;
+  int flags;
+  struct pi_buf_s *next;
+  void (*release)(struct pi_buf_s *buf, void *arg);
+  void *release_arg;
+} pi_buf_t;
+
+typedef struct pi_buf_pool_s {
+  pi_buf_t *bufs;
+  pi_buf_t *first_free;
+  struct pi_task *waiting_first;
+  struct pi_task *waiting_last;
+  void *mem;
+  int flags;
+  int nb_bufs;
+  uint32_t buf_size;
+} pi_buf_pool_t;
+
 
 typedef enum {
   RT_THREAD_STATE_READY,
@@ -398,6 +431,13 @@ typedef struct
   struct pi_cluster_task *last_call_fc;
 } rt_cluster_call_pool_t;
 
+typedef struct
+{
+  void *stacks;
+  int size;
+  unsigned int last_use;
+} rt_cluster_stacks_t;
+
 typedef struct cluster_data_t {
   int mount_count;
   rt_event_t *events;
@@ -409,6 +449,16 @@ typedef struct cluster_data_t {
   int state;
   int cid;
   rt_event_t *mount_event;
+  rt_cluster_stacks_t stacks_cache[RT_CLUSTER_STACKS_CACHE_SIZE];
+  unsigned int stacks_tick;
+  int idle_timeout;
+  int idle_check_pending;
+  int gated;
+  unsigned int idle_start;
+  int nb_tasks;
+  unsigned int nb_mounts;
+  unsigned int mount_time;
+  rt_cluster_stacks_t stacks_released[RT_CLUSTER_STACKS_CACHE_SIZE];
 } rt_fc_cluster_data_t;
 
 typedef struct {
@@ -536,9 +586,13 @@ typedef struct rt_fs_l2_s {
   uint32_t fs_offset;
   uint32_t reserved0;
   uint32_t fs_size;
-  uint32_t reserved1;
+  uint32_t fs_version;
 } rt_fs_l2_t;
 
+// Images generated before the index was added have 0 in the version word
+#define RT_FS_VERSION_MAGIC 0x46530000
+#define RT_FS_VERSION       (RT_FS_VERSION_MAGIC | 2)
+
 
 #define FS_READ_THRESHOLD            16
 #define FS_READ_THRESHOLD_BLOCK      128
@@ -620,6 +674,50 @@ typedef struct pi_cl_hyperram_alloc_req_s rt_hyperram_alloc_req_t ;
 
 typedef struct pi_cl_hyperram_free_req_s rt_hyperram_free_req_t ;
 
+typedef struct {
+  uint32_t tag;
+  uint32_t last_use;
+  uint32_t dirty;
+} pi_hyper_cache_page_t;
+
+typedef struct pi_hyper_cache_s {
+  struct pi_device *device;
+  pi_hyper_cache_page_t *pages;
+  char *data;
+  uint32_t page_size;
+  int nb_pages;
+  uint32_t tick;
+  uint32_t hits;
+  uint32_t misses;
+  int missed;
+  struct pi_task *current;
+  struct pi_task *first;
+  struct pi_task *last;
+  struct pi_task task;
+} pi_hyper_cache_t;
+
+#define PI_PREFETCH_MAX_INFLIGHT 4
+
+typedef struct pi_prefetch_s {
+  void (*read)(void *dev, uint32_t ext_addr, void *addr, uint32_t size, struct pi_task *task);
+  void *dev;
+  char *buffers;
+  uint32_t block_size;
+  uint32_t next_addr;
+  uint32_t ready_addr;
+  uint32_t end_addr;
+  uint8_t nb_buffers;
+  uint8_t nb_inflight_max;
+  uint8_t first;
+  uint8_t nb_acquired;
+  uint8_t nb_ready;
+  uint8_t nb_inflight;
+  uint8_t current_task;
+  struct pi_task *waiting_first;
+  struct pi_task *waiting_last;
+  struct pi_task tasks[PI_PREFETCH_MAX_INFLIGHT];
+} pi_prefetch_t;
+
 typedef struct {
   rt_flash_t *dev;
   void *addr;
@@ -685,6 +783,16 @@ typedef struct rt_task_s {
   unsigned char pending;
 } rt_task_t;
 
+// Per-core deque of single core tasks pushed from cluster side. The owner
+// pushes and pops at the bottom while other cores steal at the top.
+// Accesses are protected by the event unit mutex.
+typedef struct
+{
+  rt_task_t *tasks[RT_TASK_DEQUE_SIZE];
+  unsigned int top;
+  unsigned int bottom;
+} rt_task_deque_t;
+
 typedef struct
 {
   rt_task_t *__rt_task_first_fc_for_cl;
@@ -704,6 +812,58 @@ typedef struct
   int free_stacks;
 } rt_task_cluster_t;
 
+#define RT_CLUSTER_WORKER_QUEUE_SIZE_LOG2 2
+#define RT_CLUSTER_WORKER_QUEUE_SIZE (1<<RT_CLUSTER_WORKER_QUEUE_SIZE_LOG2)
+
+typedef struct
+{
+  void (*entry)(void *);
+  void *arg;
+  struct pi_task *event;
+} rt_cluster_worker_slot_t;
+
+// Shared between FC and cluster. The FC is the only one writing head and the
+// cluster the only one writing tail so that no lock is needed.
+typedef struct
+{
+  rt_cluster_worker_slot_t slots[RT_CLUSTER_WORKER_QUEUE_SIZE];
+  unsigned int head;
+  unsigned int tail;
+  int nb_cores;
+  int exit;
+} rt_cluster_worker_loc_t;
+
+typedef struct pi_cluster_worker_s
+{
+  rt_cluster_worker_loc_t *loc;
+  unsigned int trig_addr;
+  int cid;
+  struct pi_cluster_task task;
+  struct pi_task end_task;
+} pi_cluster_worker_t;
+
+#define RT_CLUSTER_GRAPH_NODE_MAX_SUCCS 4
+
+typedef struct pi_cluster_graph_node_s
+{
+  struct pi_cluster_task *task;
+  struct pi_cluster_graph_node_s *next;
+  struct pi_cluster_graph_node_s *next_ready;
+  struct pi_cluster_graph_node_s *succs[RT_CLUSTER_GRAPH_NODE_MAX_SUCCS];
+  unsigned char nb_succs;
+  unsigned char nb_preds;
+  unsigned char pending_preds;
+} pi_cluster_graph_node_t;
+
+typedef struct pi_cluster_graph_s
+{
+  pi_cluster_graph_node_t *first;
+  pi_cluster_graph_node_t *last;
+  int nb_nodes;
+  int nb_done;
+  struct pi_cluster_task task;
+} pi_cluster_graph_t;
+
 extern rt_padframe_profile_t __rt_padframe_profiles[];
 
 #ifdef ARCHI_UDMA_HAS_HYPER
@@ -794,13 +954,14 @@ extern RT_FC_TINY_DATA void *__rt_hyper_udma_handle;
 #define RT_CLUSTER_CALL_T_S_STACK_SIZE 20
 #define RT_CLUSTER_CALL_T_EVENT        24
 
-#define RT_FC_CLUSTER_DATA_T_SIZEOF       (10*4)
+#define RT_FC_CLUSTER_DATA_T_SIZEOF       (10*4 + RT_CLUSTER_STACKS_CACHE_SIZE*3*4*2 + 8*4)
 #define RT_FC_CLUSTER_DATA_T_MOUNT_COUNT  0
 #define RT_FC_CLUSTER_DATA_T_EVENTS       4
 #define RT_FC_CLUSTER_DATA_T_CALL_STACKS       8
 #define RT_FC_CLUSTER_DATA_T_CALL_STACKS_SIZE  12
 #define RT_FC_CLUSTER_DATA_T_TRIG_ADDR         16
 #define RT_FC_CLUSTER_DATA_T_CLUSTER_POOL      20
+#define RT_FC_CLUSTER_DATA_T_NB_TASKS          (10*4 + RT_CLUSTER_STACKS_CACHE_SIZE*3*4 + 5*4)
 
 #define RT_TASK_T_ENTRY       (0*4)
 #define RT_TASK_T_ARGS0       (1*4)
@@ -818,6 +979,11 @@ extern RT_FC_TINY_DATA void *__rt_hyper_udma_handle;
 #define RT_TASK_T_NB_CORES_TO_END (9*4+5)
 #define RT_TASK_T_PENDING     (9*4+6)
 
+#define RT_TASK_DEQUE_T_TASKS   0
+#define RT_TASK_DEQUE_T_TOP     (RT_TASK_DEQUE_SIZE*4)
+#define RT_TASK_DEQUE_T_BOTTOM  (RT_TASK_DEQUE_SIZE*4+4)
+#define RT_TASK_DEQUE_T_SIZEOF  (RT_TASK_DEQUE_SIZE*4+8)
+
 #define RT_CLUSTER_TASK_ENTRY                 (0*4)
 #define RT_CLUSTER_TASK_ARG                   (1*4)
 #define RT_CLUSTER_TASK_STACKS                (2*4)
@@ -46,7 +46,7 @@
  * @defgroup FS File-System
  *
  * The file-system driver provides support for accessing files on a flash. The following file-systems are available:
- *  - Read-only file system. This file-system is very basic but quite-convenient to have access to input data. The open operation does not scale well when having lots of file so this file-system should only be used with few files.
+ *  - Read-only file system. This file-system is very basic but quite-convenient to have access to input data. Images generated with a hashed index of the files can be opened in constant time, images without index are still supported but the open operation then does not scale well when having lots of files.
  *
  */
 
@@ -308,6 +308,222 @@ static inline void *rt_hyperram_alloc_cluster_wait(rt_hyperram_alloc_req_t *req)
  */
 static inline void rt_hyperram_free_cluster_wait(rt_hyperram_free_req_t *req);
 
+
+
+/** \brief Create an L2 cache in front of an HyperRAM device.
+ *
+ * The cache keeps nb_pages pages of page_size bytes in L2, replaced in LRU
+ * order. Writes only update the cache and the modified pages are written to
+ * the HyperRAM when they are replaced or when the cache is flushed.
+ * Data accessed through the cache must not be accessed directly with the
+ * HyperRAM API until the cache is flushed.
+ *
+ * \param cache     The cache structure. It must be kept alive until the cache is closed.
+ * \param device    The HyperRAM device, which must be opened.
+ * \param nb_pages  Number of pages.
+ * \param page_size Size of a page in bytes. It must be a power of 2.
+ * \return 0 if the operation is successfull, or -1 if there was not enough memory.
+ */
+int pi_hyper_cache_init(pi_hyper_cache_t *cache, struct pi_device *device, int nb_pages, uint32_t page_size);
+
+
+
+/** \brief Close an HyperRAM cache.
+ *
+ * The cache must have been flushed before and no request must be pending.
+ *
+ * \param cache     The cache structure.
+ */
+void pi_hyper_cache_deinit(pi_hyper_cache_t *cache);
+
+
+
+/** \brief Read through the cache.
+ *
+ * Requests are executed in order, one after the other.
+ *
+ * \param cache      The cache structure.
+ * \param hyper_addr The address in the HyperRAM.
+ * \param addr       The address of the buffer in L2.
+ * \param size       The size in bytes.
+ * \param task       The task used to notify the end of the read.
+ */
+void pi_hyper_cache_read_async(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size, pi_task_t *task);
+
+
+
+/** \brief Write through the cache.
+ *
+ * \param cache      The cache structure.
+ * \param hyper_addr The address in the HyperRAM.
+ * \param addr       The address of the buffer in L2.
+ * \param size       The size in bytes.
+ * \param task       The task used to notify the end of the write.
+ */
+void pi_hyper_cache_write_async(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size, pi_task_t *task);
+
+
+
+/** \brief Write all modified pages to the HyperRAM.
+ *
+ * The pages stay valid in the cache.
+ *
+ * \param cache      The cache structure.
+ * \param task       The task used to notify the end of the flush.
+ */
+void pi_hyper_cache_flush_async(pi_hyper_cache_t *cache, pi_task_t *task);
+
+
+
+/** \brief Read through the cache and wait until it is done.
+ *
+ * \param cache      The cache structure.
+ * \param hyper_addr The address in the HyperRAM.
+ * \param addr       The address of the buffer in L2.
+ * \param size       The size in bytes.
+ */
+void pi_hyper_cache_read(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size);
+
+
+
+/** \brief Write through the cache and wait until it is done.
+ *
+ * \param cache      The cache structure.
+ * \param hyper_addr The address in the HyperRAM.
+ * \param addr       The address of the buffer in L2.
+ * \param size       The size in bytes.
+ */
+void pi_hyper_cache_write(pi_hyper_cache_t *cache, uint32_t hyper_addr, void *addr, uint32_t size);
+
+
+
+/** \brief Flush the cache and wait until it is done.
+ *
+ * \param cache      The cache structure.
+ */
+void pi_hyper_cache_flush(pi_hyper_cache_t *cache);
+
+
+
+/** \brief Get the cache statistics.
+ *
+ * A hit or a miss is counted for each page accessed by a request.
+ *
+ * \param cache      The cache structure.
+ * \param hits       Filled with the number of hits.
+ * \param misses     Filled with the number of misses.
+ */
+void pi_hyper_cache_stats_get(pi_hyper_cache_t *cache, uint32_t *hits, uint32_t *misses);
+
+
+
+/** \brief Route the cluster requests of a device through a cache.
+ *
+ * Once attached, the 1D requests done with pi_cl_hyper_read and
+ * pi_cl_hyper_write on this device go through the cache, so that lookups
+ * done by the cluster hit L2. 2D requests still access the HyperRAM
+ * directly.
+ *
+ * \param device     The HyperRAM device.
+ * \param cache      The cache, or NULL to detach it.
+ */
+void pi_hyper_cache_attach(struct pi_device *device, pi_hyper_cache_t *cache);
+
+
+
+/** \brief Configure how the transfers of a device are split into bursts.
+ *
+ * Transfers are split into bursts which never cross a page boundary of the
+ * chip and which never exceed the specified maximum burst size, which is
+ * the biggest burst which can be done while respecting the maximum
+ * chip-select low time of the chip. Both 1D and 2D transfers are split,
+ * 2D transfers being split line by line.
+ * When a page size is specified, transfers whose HyperRAM address is not a
+ * multiple of 4 and which cross a burst boundary are partly done through the
+ * driver temporary buffer, and are thus slower. Without pages, they are
+ * done directly.
+ * The default is a burst of 512 bytes with no page boundary.
+ * This must be called once the device is opened and while no transfer
+ * is pending.
+ *
+ * \param device     The HyperRAM device.
+ * \param page_size  Size in bytes of a page of the chip, or 0 if bursts can
+ *   cross any boundary. It must be a power of 2.
+ * \param max_burst  Maximum size in bytes of a burst. It must be a power of
+ *   2 and at least 4.
+ * \return 0 if the operation is successfull, or -1 if the sizes are invalid.
+ */
+int pi_hyper_burst_conf(struct pi_device *device, uint32_t page_size, uint32_t max_burst);
+
+
+
+/** \brief Enqueue an asynchronous 3D read copy from HyperRAM to L2.
+ *
+ * This extends the 2D read to tiled tensors stored in HyperRAM. The tensor
+ * is made of planes, each plane being made of lines. Lines are separated
+ * by stride bytes in the HyperRAM and planes by stride_3d bytes. The data
+ * is contiguous in L2.
+ *
+ * \param device     The HyperRAM device.
+ * \param hyper_addr Address in the HyperRAM of the first line of the first plane.
+ * \param addr       Address of the buffer in L2.
+ * \param size       Total size in bytes of the copy.
+ * \param stride     Number of bytes between the beginning of 2 lines in the HyperRAM.
+ * \param length     Size in bytes of a line.
+ * \param stride_3d  Number of bytes between the beginning of 2 planes in the HyperRAM.
+ * \param length_3d  Size in bytes of a plane. It must be a multiple of length.
+ * \param task       The task used to notify the end of transfer.
+ */
+void pi_hyper_read_3d_async(struct pi_device *device, uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *task);
+
+
+
+/** \brief Enqueue a 3D read copy from HyperRAM to L2 and wait for its end.
+ *
+ * \param device     The HyperRAM device.
+ * \param hyper_addr Address in the HyperRAM of the first line of the first plane.
+ * \param addr       Address of the buffer in L2.
+ * \param size       Total size in bytes of the copy.
+ * \param stride     Number of bytes between the beginning of 2 lines in the HyperRAM.
+ * \param length     Size in bytes of a line.
+ * \param stride_3d  Number of bytes between the beginning of 2 planes in the HyperRAM.
+ * \param length_3d  Size in bytes of a plane. It must be a multiple of length.
+ */
+void pi_hyper_read_3d(struct pi_device *device, uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d);
+
+
+
+/** \brief Enqueue an asynchronous 3D write copy from L2 to HyperRAM.
+ *
+ * This is the write counterpart of pi_hyper_read_3d_async.
+ *
+ * \param device     The HyperRAM device.
+ * \param hyper_addr Address in the HyperRAM of the first line of the first plane.
+ * \param addr       Address of the buffer in L2.
+ * \param size       Total size in bytes of the copy.
+ * \param stride     Number of bytes between the beginning of 2 lines in the HyperRAM.
+ * \param length     Size in bytes of a line.
+ * \param stride_3d  Number of bytes between the beginning of 2 planes in the HyperRAM.
+ * \param length_3d  Size in bytes of a plane. It must be a multiple of length.
+ * \param task       The task used to notify the end of transfer.
+ */
+void pi_hyper_write_3d_async(struct pi_device *device, uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d, pi_task_t *task);
+
+
+
+/** \brief Enqueue a 3D write copy from L2 to HyperRAM and wait for its end.
+ *
+ * \param device     The HyperRAM device.
+ * \param hyper_addr Address in the HyperRAM of the first line of the first plane.
+ * \param addr       Address of the buffer in L2.
+ * \param size       Total size in bytes of the copy.
+ * \param stride     Number of bytes between the beginning of 2 lines in the HyperRAM.
+ * \param length     Size in bytes of a line.
+ * \param stride_3d  Number of bytes between the beginning of 2 planes in the HyperRAM.
+ * \param length_3d  Size in bytes of a plane. It must be a multiple of length.
+ */
+void pi_hyper_write_3d(struct pi_device *device, uint32_t hyper_addr, void *addr, uint32_t size, uint32_t stride, uint32_t length, uint32_t stride_3d, uint32_t length_3d);
+
 //!@}
 
 /**
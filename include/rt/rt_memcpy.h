@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RT_RT_MEMCPY_H__
+#define __RT_RT_MEMCPY_H__
+
+/**        
+ * @ingroup groupKernel        
+ */
+
+/**        
+ * @defgroup Memcpy Bulk memory copy
+ *
+ * Asynchronous copy and fill of L2 buffers from the fabric controller.
+ * Big requests are processed in chunks from the event scheduler, so that
+ * other events and tasks keep being executed while they are in progress.
+ */
+
+/**        
+ * @addtogroup Memcpy
+ * @{        
+ */
+
+/**@{*/
+
+/** Requests up to this size are executed directly when they are enqueued. */
+#define PI_FC_COPY_SYNC_SIZE   256
+
+/** Number of bytes processed each time the scheduler executes the copy service. */
+#define PI_FC_COPY_CHUNK_SIZE  1024
+
+
+
+/** \brief Copy a buffer asynchronously.
+ *
+ * The source and destination must not overlap. Requests are processed in
+ * the order in which they are enqueued.
+ * Can only be called from fabric controller.
+ *
+ * \param dst   Destination buffer.
+ * \param src   Source buffer.
+ * \param size  Number of bytes to copy.
+ * \param task  The task used to notify the end of the copy.
+ */
+void pi_fc_memcpy_async(void *dst, const void *src, uint32_t size, pi_task_t *task);
+
+
+
+/** \brief Fill a buffer asynchronously.
+ *
+ * Requests are processed in the order in which they are enqueued.
+ * Can only be called from fabric controller.
+ *
+ * \param dst   Destination buffer.
+ * \param value Value written to each byte.
+ * \param size  Number of bytes to fill.
+ * \param task  The task used to notify the end of the fill.
+ */
+void pi_fc_memset_async(void *dst, int value, uint32_t size, pi_task_t *task);
+
+
+
+//!@}
+
+/**        
+ * @} end of Memcpy group        
+ */
+
+
+
+/// @cond IMPLEM
+
+// Synchronous copy using the widest accesses allowed by the alignments,
+// for the small copies done by drivers
+void __rt_memcpy_fast(void *dst, const void *src, uint32_t size);
+
+void __rt_memset_fast(void *dst, int value, uint32_t size);
+
+/// @endcond
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RT_RT_PREFETCH_H__
+#define __RT_RT_PREFETCH_H__
+
+/**        
+ * @ingroup groupDrivers        
+ */
+
+/**        
+ * @defgroup Prefetch Sequential prefetcher
+ *
+ * A prefetcher reads a contiguous area of an external memory, like an
+ * HyperRAM or a flash, block after block into a ring of L2 buffers. Several
+ * reads are kept in flight so that the external bus does not wait for the
+ * application between blocks.
+ * The blocks are given to the application in order without any copy, and
+ * must be released in the same order so that their buffers can be filled
+ * again.
+ * The device must execute its reads in the order in which they are
+ * enqueued, which is the case for the HyperRAM and flash drivers.
+ */
+
+/**        
+ * @addtogroup Prefetch
+ * @{        
+ */
+
+/**@{*/
+
+/** \brief Start prefetching an area.
+ *
+ * The first reads are enqueued immediately.
+ * Can only be called from fabric controller.
+ *
+ * \param prefetch    The prefetcher structure. It must be kept alive until all blocks have been released.
+ * \param read        The function enqueueing a read to the device, see pi_prefetch_hyper_read and pi_prefetch_flash_read.
+ * \param dev         The device given to the read function.
+ * \param ext_addr    Address of the area in the external memory.
+ * \param size        Size in bytes of the area.
+ * \param buffers     L2 area containing nb_buffers buffers of block_size bytes.
+ * \param block_size  Size in bytes of a block.
+ * \param nb_buffers  Number of buffers in the ring.
+ * \param nb_inflight Maximum number of reads in flight, which must be at most PI_PREFETCH_MAX_INFLIGHT.
+ * \return 0 if the operation is successfull, or -1 if the parameters are not valid.
+ */
+int pi_prefetch_start(pi_prefetch_t *prefetch,
+  void (*read)(void *dev, uint32_t ext_addr, void *addr, uint32_t size, pi_task_t *task), void *dev,
+  uint32_t ext_addr, uint32_t size, void *buffers, uint32_t block_size, int nb_buffers, int nb_inflight);
+
+
+
+/** \brief Get the next block.
+ *
+ * The task is notified once the block is in L2 and pi_prefetch_status
+ * returns its buffer and size. The size is 0 once the whole area has been
+ * given.
+ *
+ * \param prefetch    The prefetcher structure.
+ * \param task        The task used to notify when the block is available.
+ */
+void pi_prefetch_acquire_async(pi_prefetch_t *prefetch, pi_task_t *task);
+
+
+
+/** \brief Release the oldest acquired block.
+ *
+ * Its buffer is then used for the next read.
+ *
+ * \param prefetch    The prefetcher structure.
+ */
+void pi_prefetch_release(pi_prefetch_t *prefetch);
+
+
+
+/** \brief Get the block given by pi_prefetch_acquire_async.
+ *
+ * \param task        The task given to pi_prefetch_acquire_async.
+ * \param size        Filled with the size of the block.
+ * \return The buffer containing the block.
+ */
+static inline void *pi_prefetch_status(pi_task_t *task, uint32_t *size);
+
+
+
+//!@}
+
+/**        
+ * @} end of Prefetch group        
+ */
+
+
+
+/// @cond IMPLEM
+
+static inline void *pi_prefetch_status(pi_task_t *task, uint32_t *size)
+{
+  if (size)
+    *size = task->implem.data[1];
+  return (void *)task->implem.data[0];
+}
+
+#if defined(ARCHI_UDMA_HAS_HYPER)
+static inline void pi_prefetch_hyper_read(void *dev, uint32_t ext_addr, void *addr, uint32_t size, pi_task_t *task)
+{
+  pi_hyper_read_async((struct pi_device *)dev, ext_addr, addr, size, task);
+}
+#endif
+
+static inline void pi_prefetch_flash_read(void *dev, uint32_t ext_addr, void *addr, uint32_t size, pi_task_t *task)
+{
+  rt_flash_read((rt_flash_t *)dev, addr, (void *)ext_addr, size, task);
+}
+
+/// @endcond
+
+#endif
@@ -170,6 +170,9 @@ void rt_task_fc_push(rt_task_cluster_t *cluster, rt_task_t *task, rt_event_t *ev
  *
  * This function can be called to push a task for execution from cluster side.
  * The task is pushed to the cluster from which this function is called.
+ * Single core tasks are pushed to a deque private to the calling core, from
+ * which they are popped in LIFO order by this core or stolen in FIFO order by
+ * idle cores. Multi-core tasks are pushed to a queue shared by all cores.
  * Once this function is called, the task must not be modified anymore.
  * This function must be called only from cluster side.
  *
@@ -191,6 +194,73 @@ void rt_task_cl_wait(rt_task_t *task);
 
 
 
+/** \brief Initialize a cluster task graph.
+ *
+ * A task graph is a set of cluster tasks linked by dependency edges. The whole
+ * graph is sent to the cluster at once and the cluster executes each task as
+ * soon as all the tasks it depends on are finished, without going back to the
+ * fabric controller between them. A single notification is sent to the fabric
+ * controller when the whole graph is over.
+ * The graph must not contain any cycle.
+ *
+ * \param graph A pointer to the graph structure. It must be kept alive until the graph has been executed.
+ */
+void pi_cluster_graph_init(pi_cluster_graph_t *graph);
+
+
+
+/** \brief Add a node to a cluster task graph.
+ *
+ * The task entry point is executed by the cluster master core, exactly as
+ * for a task sent with pi_cluster_send_task_to_cl. All tasks of a graph share
+ * the same team of cores and the same stacks, which are sized with the maximum
+ * values found in the tasks of the graph.
+ *
+ * \param graph A pointer to the graph structure.
+ * \param node  A pointer to the node structure. It must be kept alive until the graph has been executed.
+ * \param task  The cluster task executed by this node.
+ */
+void pi_cluster_graph_node_add(pi_cluster_graph_t *graph, pi_cluster_graph_node_t *node, struct pi_cluster_task *task);
+
+
+
+/** \brief Add a dependency edge between two nodes.
+ *
+ * The node to will only be executed once the node from is finished.
+ * A node can have at most RT_CLUSTER_GRAPH_NODE_MAX_SUCCS successors.
+ *
+ * \param from  The node which must be executed first.
+ * \param to    The node depending on from.
+ * \return 0 if the operation is successfull, or -1 if from has too many successors.
+ */
+int pi_cluster_graph_edge_add(pi_cluster_graph_node_t *from, pi_cluster_graph_node_t *to);
+
+
+
+/** \brief Send a task graph to the cluster.
+ *
+ * The graph must not be modified until the task is pushed. The graph can be
+ * sent again once it is finished.
+ *
+ * \param device  The cluster device.
+ * \param graph   A pointer to the graph structure.
+ * \param task    The task used to notify the end of the whole graph.
+ * \return 0 if the operation is successfull, or -1 if it failed.
+ */
+int pi_cluster_graph_send_async(struct pi_device *device, pi_cluster_graph_t *graph, pi_task_t *task);
+
+
+
+/** \brief Send a task graph to the cluster and wait until it is finished.
+ *
+ * \param device  The cluster device.
+ * \param graph   A pointer to the graph structure.
+ * \return 0 if the operation is successfull, or -1 if it failed.
+ */
+int pi_cluster_graph_send(struct pi_device *device, pi_cluster_graph_t *graph);
+
+
+
 //!@}
 
 /**        
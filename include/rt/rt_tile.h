@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RT_RT_TILE_H__
+#define __RT_RT_TILE_H__
+
+#include <stdint.h>
+
+/**        
+ * @ingroup groupCluster        
+ */
+
+/**        
+ * @defgroup Tile Tile planner
+ *
+ * The tile planner computes the shape of the tiles used to process a 2D or
+ * 3D tensor through the cluster memory. It only depends on the C library so
+ * that it can also be compiled and checked on the host.
+ */
+
+/**        
+ * @addtogroup Tile
+ * @{        
+ */
+
+/**@{*/
+
+/** Estimated cost, in bytes, of transfering one more line with the DMA. */
+#define PI_TILE_LINE_COST 16
+
+/** Estimated cost, in bytes, of processing one more tile. */
+#define PI_TILE_TILE_COST 256
+
+
+
+/** \struct pi_tile_plan_t
+ * \brief Tile plan.
+ *
+ * The first fields describe the workload and must be filled before calling
+ * pi_tile_plan. The other ones are filled by the planner.
+ * Dimension 0 is the innermost one, contiguous in memory.
+ */
+typedef struct
+{
+  uint32_t dims[3];      /*!< Tensor dimensions, in elements. dims[2] can be 0 or 1 for a 2D tensor. */
+  uint32_t elem_size;    /*!< Size in bytes of one element. */
+  int nb_inputs;         /*!< Number of input operands, which have the tensor shape. */
+  int nb_outputs;        /*!< Number of output operands, which have the tensor shape. */
+  uint32_t halo[2];      /*!< Number of extra elements needed on each side of an input tile for dimensions 0 and 1. */
+  int depth;             /*!< Number of buffers for each operand, e.g. 2 for double-buffering. */
+  uint32_t budget;       /*!< Number of bytes of cluster memory which can be used. */
+
+  uint32_t tile[3];      /*!< Tile dimensions, in elements. */
+  uint32_t nb_tiles[3];  /*!< Number of tiles in each dimension. */
+  uint32_t in_size;      /*!< Size in bytes of one input tile, including the halo, rounded up to a multiple of 4 as the pipeline buffers. */
+  uint32_t out_size;     /*!< Size in bytes of one output tile, rounded up to a multiple of 4 as the pipeline buffers. */
+  uint32_t footprint;    /*!< Total number of bytes of cluster memory used by the plan. */
+  uint32_t transfered;   /*!< Estimated number of bytes transfered by the DMA for the whole tensor. */
+} pi_tile_plan_t;
+
+
+
+/** \brief Compute a tile plan.
+ *
+ * This looks for the tile shape which minimizes the estimated cost of
+ * processing the whole tensor, while keeping all the buffers in the memory
+ * budget. The cost counts the transfered bytes, including the halo which is
+ * transfered several times, the number of DMA lines, which makes
+ * narrow tiles expensive, and the number of tiles.
+ * The budget is typically the free memory reported by rt_user_alloc_info
+ * for the cluster allocator, minus what the kernel needs for other purposes.
+ *
+ * \param plan The plan, whose workload fields must be filled.
+ * \return 0 if a plan was found, or -1 if even the smallest tile does not fit in the budget.
+ */
+int pi_tile_plan(pi_tile_plan_t *plan);
+
+
+
+/** \brief Get the coordinates of a tile.
+ *
+ * Tiles are numbered with dimension 0 varying fastest. Tiles on the
+ * tensor boundaries can be smaller than the plan tile shape, the returned
+ * sizes are the real ones. The halo is not included.
+ *
+ * \param plan  The plan.
+ * \param tile  The tile index.
+ * \param pos   Filled with the position of the first element of the tile in each dimension.
+ * \param size  Filled with the size of the tile in each dimension.
+ */
+void pi_tile_plan_coords(pi_tile_plan_t *plan, int tile, uint32_t pos[3], uint32_t size[3]);
+
+
+
+/** \brief Check a tile plan against the DMA pipeline.
+ *
+ * Computes the size of every tile as the DMA pipeline does, with the halo
+ * clipped on the tensor boundaries and the buffers rounded up to a multiple
+ * of 4, and checks that the pipeline gets plan->depth buffers from
+ * plan->footprint bytes. This is mostly useful for checking the planner on
+ * the host.
+ *
+ * \param plan  The plan computed by pi_tile_plan.
+ * \return 0 if the plan fits, or -1 if the pipeline would need more memory.
+ */
+int pi_tile_plan_check(pi_tile_plan_t *plan);
+
+
+
+//!@}
+
+/**        
+ * @} end of Tile group        
+ */
+
+#endif
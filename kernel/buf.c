@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rt/rt_api.h"
+
+static void __rt_buf_reset(pi_buf_t *buf)
+{
+  buf->refcount = 1;
+  buf->length = buf->size;
+}
+
+
+
+int pi_buf_pool_init(pi_buf_pool_t *pool, rt_alloc_e flags, int nb_bufs, uint32_t size)
+{
+  // Keep each buffer word-aligned so that they can be used by the DMAs
+  size = (size + 3) & ~3;
+
+  pool->bufs = rt_alloc(flags, sizeof(pi_buf_t) * nb_bufs);
+  if (pool->bufs == NULL)
+    goto error;
+
+  pool->mem = rt_alloc(flags, size * nb_bufs);
+  if (pool->mem == NULL)
+    goto error_mem;
+
+  pool->flags = flags;
+  pool->nb_bufs = nb_bufs;
+  pool->buf_size = size;
+  pool->first_free = NULL;
+  pool->waiting_first = NULL;
+
+  for (int i=nb_bufs-1; i>=0; i--)
+  {
+    pi_buf_t *buf = &pool->bufs[i];
+    buf->addr = (void *)((uint32_t)pool->mem + size * i);
+    buf->size = size;
+    buf->pool = pool;
+    buf->release = NULL;
+    buf->refcount = 0;
+    buf->next = pool->first_free;
+    pool->first_free = buf;
+  }
+
+  return 0;
+
+error_mem:
+  rt_free(flags, pool->bufs, sizeof(pi_buf_t) * nb_bufs);
+error:
+  return -1;
+}
+
+
+
+void pi_buf_pool_deinit(pi_buf_pool_t *pool)
+{
+  rt_free(pool->flags, pool->mem, pool->buf_size * pool->nb_bufs);
+  rt_free(pool->flags, pool->bufs, sizeof(pi_buf_t) * pool->nb_bufs);
+}
+
+
+
+pi_buf_t *pi_buf_get(pi_buf_pool_t *pool)
+{
+  int irq = rt_irq_disable();
+
+  pi_buf_t *buf = pool->first_free;
+  if (buf)
+  {
+    pool->first_free = buf->next;
+    __rt_buf_reset(buf);
+  }
+
+  rt_irq_restore(irq);
+
+  return buf;
+}
+
+
+
+void pi_buf_get_async(pi_buf_pool_t *pool, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  __rt_task_init(task);
+
+  pi_buf_t *buf = pool->first_free;
+  if (buf)
+  {
+    pool->first_free = buf->next;
+    __rt_buf_reset(buf);
+    task->implem.data[0] = (int)buf;
+    __rt_event_enqueue(task);
+  }
+  else
+  {
+    if (pool->waiting_first)
+      pool->waiting_last->implem.next = task;
+    else
+      pool->waiting_first = task;
+
+    task->implem.next = NULL;
+    pool->waiting_last = task;
+  }
+
+  rt_irq_restore(irq);
+}
+
+
+
+pi_buf_t *pi_buf_alloc(rt_alloc_e flags, uint32_t size)
+{
+  size = (size + 3) & ~3;
+
+  pi_buf_t *buf = rt_alloc(flags, sizeof(pi_buf_t) + size);
+  if (buf == NULL)
+    return NULL;
+
+  buf->addr = (void *)((uint32_t)buf + sizeof(pi_buf_t));
+  buf->size = size;
+  buf->pool = NULL;
+  buf->flags = flags;
+  buf->release = NULL;
+  __rt_buf_reset(buf);
+
+  return buf;
+}
+
+
+
+void pi_buf_init(pi_buf_t *buf, void *addr, uint32_t size, void (*release)(pi_buf_t *buf, void *arg), void *arg)
+{
+  buf->addr = addr;
+  buf->size = size;
+  buf->pool = NULL;
+  buf->release = release;
+  buf->release_arg = arg;
+  __rt_buf_reset(buf);
+}
+
+
+
+void pi_buf_unref(pi_buf_t *buf)
+{
+  int irq = rt_irq_disable();
+
+  if (--buf->refcount == 0)
+  {
+    pi_buf_pool_t *pool = buf->pool;
+
+    if (buf->release)
+    {
+      buf->release(buf, buf->release_arg);
+    }
+    else if (pool == NULL)
+    {
+      rt_free(buf->flags, buf, sizeof(pi_buf_t) + buf->size);
+    }
+    else
+    {
+      // Give the buffer directly to the first waiting user, if any, so
+      // that it does not go through the free list
+      pi_task_t *task = pool->waiting_first;
+      if (task)
+      {
+        pool->waiting_first = task->implem.next;
+        __rt_buf_reset(buf);
+        task->implem.data[0] = (int)buf;
+        __rt_event_enqueue(task);
+      }
+      else
+      {
+        buf->next = pool->first_free;
+        pool->first_free = buf;
+      }
+    }
+  }
+
+  rt_irq_restore(irq);
+}
@@ -87,7 +87,15 @@ static void __rt_init_cluster_data(int cid)
 
   int nb_cluster = rt_nb_cluster();
 
+  // L1 allocator is reinitialized at each mount, so the stacks allocated
+  // during the previous one are lost. The size of the reserved stacks is
+  // kept so that they can be allocated again when resuming.
   __rt_fc_cluster_data[cid].stacks = NULL;
+  for (int i=0; i<RT_CLUSTER_STACKS_CACHE_SIZE; i++)
+  {
+    __rt_fc_cluster_data[cid].stacks_cache[i].stacks = NULL;
+    __rt_fc_cluster_data[cid].stacks_released[i].stacks = NULL;
+  }
   __rt_fc_cluster_data[cid].trig_addr = eu_evt_trig_cluster_addr(cid, RT_CLUSTER_CALL_EVT);
   __rt_fc_cluster_data[cid].pool = (rt_cluster_call_pool_t *)rt_cluster_tiny_addr(cid, &__rt_cluster_pool);
 
@@ -340,6 +348,161 @@ void pi_cluster_conf_init(struct pi_cluster_conf *conf)
 }
 
 
+static pi_task_t __rt_cluster_idle_task[ARCHI_NB_CLUSTER];
+
+static void __rt_cluster_idle_check(void *arg);
+
+
+
+static int __rt_cluster_mount_sync(rt_fc_cluster_data_t *cluster)
+{
+  unsigned int start = rt_time_get_us();
+
+  rt_event_t *event = __rt_wait_event_prepare_blocking();
+
+  if (__rt_cluster_mount(cluster, cluster->cid, 0, event))
+    return -1;
+
+  __rt_wait_event(event);
+
+  cluster->gated = 0;
+  cluster->nb_tasks = 0;
+  cluster->nb_mounts++;
+  cluster->mount_time += rt_time_get_us() - start;
+
+  return 0;
+}
+
+
+
+static void __rt_cluster_idle_check_push(rt_fc_cluster_data_t *cluster, int time_us)
+{
+  pi_task_t *task = &__rt_cluster_idle_task[cluster->cid];
+
+  cluster->idle_check_pending = 1;
+  pi_task_callback(task, __rt_cluster_idle_check, (void *)cluster);
+  rt_event_push_delayed(task, time_us);
+}
+
+
+
+// The cluster does not notify the FC when it becomes idle, so the number of
+// tasks still executing on it is polled at a fraction of the timeout, and the
+// idle time is counted from the first check seeing no task.
+static void __rt_cluster_idle_check(void *arg)
+{
+  rt_fc_cluster_data_t *cluster = (rt_fc_cluster_data_t *)arg;
+
+  int irq = rt_irq_disable();
+
+  cluster->idle_check_pending = 0;
+
+  if (cluster->idle_timeout == 0 || cluster->gated)
+    goto end;
+
+  unsigned int now = rt_time_get_us();
+
+  if (cluster->nb_tasks)
+  {
+    cluster->idle_start = 0;
+    __rt_cluster_idle_check_push(cluster, (cluster->idle_timeout >> 2) + 1);
+    goto end;
+  }
+
+  if (cluster->idle_start == 0)
+  {
+    cluster->idle_start = now | 1;
+    __rt_cluster_idle_check_push(cluster, cluster->idle_timeout);
+    goto end;
+  }
+
+  int remaining = cluster->idle_timeout - (int)(now - cluster->idle_start);
+  if (remaining > 0)
+  {
+    __rt_cluster_idle_check_push(cluster, remaining);
+    goto end;
+  }
+
+  rt_trace(RT_TRACE_CONF, "Power-gating idle cluster (cluster: %d)\n", cluster->cid);
+
+  __rt_cluster_unmount(cluster->cid, 0, NULL);
+  cluster->gated = 1;
+
+end:
+  rt_irq_restore(irq);
+}
+
+
+
+void __rt_cluster_activity(rt_fc_cluster_data_t *cluster)
+{
+  // Decreased by the FC handler of cluster events when the task is over, or
+  // by __rt_cluster_activity_end for the tasks which do not return to the
+  // cluster master loop
+  cluster->nb_tasks++;
+  cluster->idle_start = 0;
+
+  if (cluster->idle_timeout && !cluster->idle_check_pending)
+    __rt_cluster_idle_check_push(cluster, cluster->idle_timeout);
+}
+
+
+
+void __rt_cluster_activity_end(rt_fc_cluster_data_t *cluster)
+{
+  int irq = rt_irq_disable();
+  cluster->nb_tasks--;
+  rt_irq_restore(irq);
+}
+
+
+
+int __rt_cluster_resume(rt_fc_cluster_data_t *cluster)
+{
+  rt_trace(RT_TRACE_CONF, "Resuming power-gated cluster (cluster: %d)\n", cluster->cid);
+
+  if (__rt_cluster_mount_sync(cluster))
+    return -1;
+
+  if (cluster->stacks_size)
+  {
+    cluster->stacks = rt_user_alloc(rt_alloc_l1(cluster->cid), cluster->stacks_size);
+    if (cluster->stacks == NULL)
+      return -1;
+  }
+
+  return 0;
+}
+
+
+
+void pi_cluster_idle_timeout_set(struct pi_device *device, int timeout_us)
+{
+  rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)device->data;
+
+  int irq = rt_irq_disable();
+
+  data->idle_timeout = timeout_us;
+  data->idle_start = 0;
+
+  if (timeout_us && !data->idle_check_pending && !data->gated)
+    __rt_cluster_idle_check_push(data, timeout_us);
+
+  rt_irq_restore(irq);
+}
+
+
+
+void pi_cluster_mount_stats(struct pi_device *device, unsigned int *nb_mounts, unsigned int *mount_time_us)
+{
+  rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)device->data;
+
+  *nb_mounts = data->nb_mounts;
+  *mount_time_us = data->mount_time;
+}
+
+
+
 int pi_cluster_open(struct pi_device *cluster_dev)
 {
   int irq = rt_irq_disable();
@@ -349,16 +512,12 @@ int pi_cluster_open(struct pi_device *cluster_dev)
 
   cluster_dev->data = (void *)&__rt_fc_cluster_data[cid];
 
-  rt_event_t *event = __rt_wait_event_prepare_blocking();
-
-  if (__rt_cluster_mount(&__rt_fc_cluster_data[cid], conf->id, 0, event))
+  if (__rt_cluster_mount_sync(&__rt_fc_cluster_data[cid]))
   {
     rt_irq_restore(irq);
     return -1;
   }
 
-  __rt_wait_event(event);
-
   rt_irq_restore(irq);
 
   return 0;
@@ -371,7 +530,17 @@ int pi_cluster_close(struct pi_device *cluster_dev)
 {
   rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)cluster_dev->data;
 
-  __rt_cluster_unmount(data->cid, 0, NULL);
+  int irq = rt_irq_disable();
+
+  data->idle_timeout = 0;
+  data->stacks_size = 0;
+
+  if (!data->gated)
+    __rt_cluster_unmount(data->cid, 0, NULL);
+
+  data->gated = 0;
+
+  rt_irq_restore(irq);
 
   return 0;
 }
@@ -447,6 +616,143 @@ void __rt_cluster_push_fc_event(rt_event_t *event)
   eu_evt_trig(eu_evt_trig_addr(RT_CL_SYNC_EVENT), 0);
 }
 
+
+
+static void __rt_cluster_worker_entry(void *arg)
+{
+  rt_cluster_worker_loc_t *loc = (rt_cluster_worker_loc_t *)arg;
+  unsigned int tail = loc->tail;
+
+  while(1)
+  {
+    // Sleep until the FC publishes a new slot. Events received before we go
+    // to sleep are kept by the event unit so that no notification is lost.
+    while (tail == *(volatile unsigned int *)&loc->head)
+    {
+      if (*(volatile int *)&loc->exit)
+        return;
+
+      eu_evt_maskWaitAndClr(1<<RT_CLUSTER_CALL_EVT);
+    }
+
+    rt_cluster_worker_slot_t *slot = &loc->slots[tail & (RT_CLUSTER_WORKER_QUEUE_SIZE - 1)];
+    pi_task_t *event = slot->event;
+
+    // Slave cores are still waiting in the dispatcher with the stacks set
+    // when the worker was started, so a simple fork is enough.
+    rt_team_fork(loc->nb_cores, slot->entry, slot->arg);
+
+    // Release the slot before notifying the FC so that it can directly
+    // reuse it from the task callback.
+    tail++;
+    rt_compiler_barrier();
+    *(volatile unsigned int *)&loc->tail = tail;
+
+    __rt_cluster_push_fc_event(event);
+  }
+}
+
+
+
+int pi_cluster_worker_start(struct pi_device *device, pi_cluster_worker_t *worker, int nb_cores, int stack_size, int slave_stack_size)
+{
+  rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)device->data;
+  int cid = data->cid;
+
+  rt_cluster_worker_loc_t *loc = rt_user_alloc(rt_alloc_l1(cid), sizeof(rt_cluster_worker_loc_t));
+  if (loc == NULL)
+    return -1;
+
+  if (nb_cores == 0)
+    nb_cores = pi_cl_cluster_nb_cores();
+
+  loc->head = 0;
+  loc->tail = 0;
+  loc->exit = 0;
+  loc->nb_cores = nb_cores;
+
+  worker->loc = loc;
+  worker->cid = cid;
+  worker->trig_addr = data->trig_addr;
+
+  struct pi_cluster_task *task = &worker->task;
+  pi_cluster_task(task, __rt_cluster_worker_entry, loc);
+  task->stack_size = stack_size;
+  task->slave_stack_size = slave_stack_size;
+  task->nb_cores = nb_cores;
+
+  pi_task_block(&worker->end_task);
+
+  if (pi_cluster_send_task_to_cl_async(device, task, &worker->end_task))
+  {
+    rt_user_free(rt_alloc_l1(cid), loc, sizeof(rt_cluster_worker_loc_t));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+void pi_cluster_worker_send_async(pi_cluster_worker_t *worker, void (*entry)(void *), void *arg, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  rt_cluster_worker_loc_t *loc = worker->loc;
+  unsigned int head = loc->head;
+
+  __rt_task_init(task);
+
+  // All slots are used, let the scheduler run until the cluster releases one.
+  // The cluster releases the slot before pushing the end of task, which
+  // will wake us up.
+  while (head - *(volatile unsigned int *)&loc->tail == RT_CLUSTER_WORKER_QUEUE_SIZE)
+  {
+    __rt_event_execute(NULL, 1);
+  }
+
+  rt_cluster_worker_slot_t *slot = &loc->slots[head & (RT_CLUSTER_WORKER_QUEUE_SIZE - 1)];
+  slot->entry = entry;
+  slot->arg = arg;
+  slot->event = task;
+
+  // The slot must be fully written before the cluster can see the new head
+  rt_compiler_barrier();
+  loc->head = head + 1;
+  rt_compiler_barrier();
+
+  eu_evt_trig(worker->trig_addr, 0);
+
+  rt_irq_restore(irq);
+}
+
+
+
+void pi_cluster_worker_send(pi_cluster_worker_t *worker, void (*entry)(void *), void *arg)
+{
+  pi_task_t task;
+  pi_task_block(&task);
+  pi_cluster_worker_send_async(worker, entry, arg, &task);
+  pi_task_wait_on(&task);
+}
+
+
+
+void pi_cluster_worker_stop(pi_cluster_worker_t *worker)
+{
+  rt_cluster_worker_loc_t *loc = worker->loc;
+
+  loc->exit = 1;
+  rt_compiler_barrier();
+  eu_evt_trig(worker->trig_addr, 0);
+
+  // The worker only leaves once its queue is empty, after which the cluster
+  // task used to start it is terminated.
+  pi_task_wait_on(&worker->end_task);
+
+  rt_user_free(rt_alloc_l1(worker->cid), loc, sizeof(rt_cluster_worker_loc_t));
+}
+
 #endif
 
 
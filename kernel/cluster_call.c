@@ -62,12 +62,162 @@ void cluster_irq_handler(void *arg)
 }
 #endif
 
+// Stacks may still be used by a task executing on the cluster, so their free
+// is deferred until the cluster has no task in flight. Nothing is freed while
+// the cluster is power-gated, as its memory is lost.
+static int __rt_cluster_stacks_free(rt_fc_cluster_data_t *data, void *stacks, int size)
+{
+  if (data->gated)
+    return 0;
+
+  if (data->nb_tasks == 0)
+  {
+    rt_user_free(rt_alloc_l1(data->cid), stacks, size);
+    return 0;
+  }
+
+  for (int i=0; i<RT_CLUSTER_STACKS_CACHE_SIZE; i++)
+  {
+    rt_cluster_stacks_t *entry = &data->stacks_released[i];
+    if (entry->stacks == NULL)
+    {
+      entry->stacks = stacks;
+      entry->size = size;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+
+
+// Frees the stacks whose free was deferred, once the cluster is idle
+static void __rt_cluster_stacks_release(rt_fc_cluster_data_t *data)
+{
+  if (data->nb_tasks || data->gated)
+    return;
+
+  for (int i=0; i<RT_CLUSTER_STACKS_CACHE_SIZE; i++)
+  {
+    rt_cluster_stacks_t *entry = &data->stacks_released[i];
+    if (entry->stacks)
+    {
+      rt_user_free(rt_alloc_l1(data->cid), entry->stacks, entry->size);
+      entry->stacks = NULL;
+    }
+  }
+}
+
+
+
+// Returns stacks of at least the specified size. The reserved stacks are
+// used first, then the smallest cached block which is big enough. If none
+// is found, the least recently used block is replaced by a new one.
+static void *__rt_cluster_stacks_get(rt_fc_cluster_data_t *data, int size)
+{
+  rt_cluster_stacks_t *best = NULL;
+  rt_cluster_stacks_t *victim = NULL;
+
+  __rt_cluster_stacks_release(data);
+
+  if (data->stacks && size <= data->stacks_size)
+    return data->stacks;
+
+  for (int i=0; i<RT_CLUSTER_STACKS_CACHE_SIZE; i++)
+  {
+    rt_cluster_stacks_t *entry = &data->stacks_cache[i];
+
+    if (entry->stacks == NULL)
+    {
+      if (victim == NULL || victim->stacks)
+        victim = entry;
+    }
+    else
+    {
+      if (entry->size >= size && (best == NULL || entry->size < best->size))
+        best = entry;
+
+      if (victim == NULL || (victim->stacks && entry->last_use < victim->last_use))
+        victim = entry;
+    }
+  }
+
+  if (best == NULL)
+  {
+    if (victim->stacks)
+    {
+      if (__rt_cluster_stacks_free(data, victim->stacks, victim->size))
+        return NULL;
+      victim->stacks = NULL;
+    }
+
+    victim->size = size;
+    victim->stacks = rt_user_alloc(rt_alloc_l1(data->cid), size);
+    if (victim->stacks == NULL)
+      return NULL;
+
+    best = victim;
+  }
+
+  best->last_use = data->stacks_tick++;
+
+  return best->stacks;
+}
+
+
+
+int pi_cluster_stacks_reserve(struct pi_device *device, int stack_size, int slave_stack_size, int nb_cores)
+{
+  rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)device->data;
+
+  int lock = __rt_cluster_lock(data);
+
+  if (nb_cores == 0)
+    nb_cores = pi_cl_cluster_nb_cores();
+
+  if (slave_stack_size == 0)
+    slave_stack_size = stack_size;
+
+  int stacks_size = stack_size + slave_stack_size * (nb_cores - 1);
+
+  __rt_cluster_stacks_release(data);
+
+  if (data->stacks && __rt_cluster_stacks_free(data, data->stacks, data->stacks_size))
+    goto error;
+
+  data->stacks = NULL;
+  data->stacks_size = stacks_size;
+
+  // The L1 memory of a power-gated cluster is lost, the stacks are then
+  // allocated when it is resumed
+  if (!data->gated)
+  {
+    data->stacks = rt_user_alloc(rt_alloc_l1(data->cid), stacks_size);
+    if (data->stacks == NULL)
+      data->stacks_size = 0;
+  }
+
+  __rt_cluster_unlock(data, lock);
+
+  return data->stacks_size == 0 ? -1 : 0;
+
+error:
+  __rt_cluster_unlock(data, lock);
+  return -1;
+}
+
+
+
 int pi_cluster_send_task_to_cl_async(struct pi_device *device, struct pi_cluster_task *task, pi_task_t *async_task)
 {
   rt_fc_cluster_data_t *data = (rt_fc_cluster_data_t *)device->data;
 
   int lock = __rt_cluster_lock(data);
 
+  if (data->gated && __rt_cluster_resume(data))
+    goto error;
+
   __rt_task_init(async_task);
   
   task->implem.pending = 1;
@@ -90,19 +240,9 @@ int pi_cluster_send_task_to_cl_async(struct pi_device *device, struct pi_cluster
 
     int stacks_size = task->stack_size + task->slave_stack_size * (task->nb_cores - 1);
 
-    if (data->stacks == NULL || stacks_size != data->stacks_size)
-    {
-      if (data->stacks)
-        rt_user_free(rt_alloc_l1(data->cid), data->stacks, data->stacks_size);
-
-      data->stacks_size = stacks_size;
-      data->stacks = rt_user_alloc(rt_alloc_l1(data->cid), stacks_size);
-
-      if (data->stacks == NULL)
-        goto error;
-    }
-
-    task->stacks = data->stacks;
+    task->stacks = __rt_cluster_stacks_get(data, stacks_size);
+    if (task->stacks == NULL)
+      goto error;
   }
 
   task->completion_callback = async_task;
@@ -135,6 +275,8 @@ int pi_cluster_send_task_to_cl_async(struct pi_device *device, struct pi_cluster
   rt_compiler_barrier();
   eu_evt_trig(eu_evt_trig_cluster_addr(data->cid, RT_CLUSTER_CALL_EVT), 0);
 
+  __rt_cluster_activity(data);
+
   __rt_cluster_unlock(data, lock);
 
   return 0;
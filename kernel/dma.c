@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+
+#if defined(MCHAN_VERSION)
+
+// Biggest stride which can be given to a 2D command on all DMA versions
+#define __CL_DMA_MAX_2D_STRIDE (1<<15)
+
+#ifdef __RT_USE_DMA_PROFILE
+RT_L1_DATA pi_cl_dma_stats_t __rt_dma_stats[ARCHI_CLUSTER_NB_PE];
+#endif
+
+void pi_cl_dma_stats_get(int core_id, pi_cl_dma_stats_t *stats)
+{
+#ifdef __RT_USE_DMA_PROFILE
+  *stats = __rt_dma_stats[core_id];
+#else
+  stats->bytes = 0;
+  stats->nb_cmds = 0;
+  stats->wait_cycles = 0;
+  stats->alloc_cycles = 0;
+#endif
+}
+
+void pi_cl_dma_stats_reset()
+{
+#ifdef __RT_USE_DMA_PROFILE
+  for (int i=0; i<ARCHI_CLUSTER_NB_PE; i++)
+  {
+    __rt_dma_stats[i].bytes = 0;
+    __rt_dma_stats[i].nb_cmds = 0;
+    __rt_dma_stats[i].wait_cycles = 0;
+    __rt_dma_stats[i].alloc_cycles = 0;
+  }
+#endif
+}
+
+static inline int __cl_dma_counter_alloc()
+{
+  uint32_t start = __cl_dma_profile_time();
+  int id = plp_dma_counter_alloc();
+  __cl_dma_profile_alloc(start);
+  return id;
+}
+
+static void __cl_dma_counter_wait(int id)
+{
+  pi_cl_dma_cmd_t cmd;
+  cmd.id = id;
+  cmd.length = 0;
+  __cl_dma_wait(&cmd);
+}
+
+// Pushes the next command of a large transfer. Must be called with the DMA
+// lock taken.
+static void __cl_dma_large_push_cmd(pi_cl_dma_large_t *copy)
+{
+  uint32_t length = copy->length;
+  uint32_t size = copy->size;
+
+  if (copy->line_pos == 0 && copy->stride && copy->stride < __CL_DMA_MAX_2D_STRIDE &&
+    length <= PI_CL_DMA_LARGE_BURST_SIZE && size >= length)
+  {
+    uint32_t nb_lines = PI_CL_DMA_LARGE_BURST_SIZE / length;
+    if (nb_lines > size / length)
+      nb_lines = size / length;
+
+    uint32_t bytes = nb_lines * length;
+    unsigned int cmd = plp_dma_getCmd(copy->dir, bytes, PLP_DMA_2D, PLP_DMA_TRIG_EVT, PLP_DMA_NO_TRIG_IRQ, PLP_DMA_SHARED);
+    plp_dma_cmd_push_2d(cmd, copy->loc, copy->ext, copy->stride, length);
+    __cl_dma_profile_cmd(bytes);
+
+    copy->ext += nb_lines * copy->stride;
+    copy->loc += bytes;
+    copy->size -= bytes;
+  }
+  else
+  {
+    uint32_t bytes = length - copy->line_pos;
+    if (bytes > PI_CL_DMA_LARGE_BURST_SIZE)
+      bytes = PI_CL_DMA_LARGE_BURST_SIZE;
+    if (bytes > size)
+      bytes = size;
+
+    unsigned int cmd = plp_dma_getCmd(copy->dir, bytes, PLP_DMA_1D, PLP_DMA_TRIG_EVT, PLP_DMA_NO_TRIG_IRQ, PLP_DMA_SHARED);
+    plp_dma_cmd_push(cmd, copy->loc, copy->ext + copy->line_pos);
+    __cl_dma_profile_cmd(bytes);
+
+    copy->loc += bytes;
+    copy->size -= bytes;
+    copy->line_pos += bytes;
+    if (copy->line_pos == length)
+    {
+      copy->line_pos = 0;
+      copy->ext += copy->stride;
+    }
+  }
+}
+
+// Pushes a batch of commands, all attached to the same counter, so that
+// the whole batch can be waited at once.
+static void __cl_dma_large_push(pi_cl_dma_large_t *copy, int slot)
+{
+  int lock = __cl_dma_lock();
+
+  copy->ids[slot] = __cl_dma_counter_alloc();
+
+  // Prevent the compiler from pushing the transfer before all previous
+  // stores are done
+  __asm__ __volatile__ ("" : : : "memory");
+
+  for (int i=0; i<PI_CL_DMA_LARGE_BATCH && copy->size; i++)
+  {
+    __cl_dma_large_push_cmd(copy);
+  }
+
+  __cl_dma_unlock(lock);
+}
+
+static void __cl_dma_large_start(pi_cl_dma_large_t *copy)
+{
+  copy->line_pos = 0;
+  copy->current = 0;
+  copy->ids[0] = -1;
+  copy->ids[1] = -1;
+
+  __cl_dma_large_push(copy, 0);
+
+  if (copy->size)
+    __cl_dma_large_push(copy, 1);
+}
+
+void pi_cl_dma_memcpy_large(uint32_t ext, uint32_t loc, uint32_t size, pi_cl_dma_dir_e dir, pi_cl_dma_large_t *copy)
+{
+  copy->ext = ext;
+  copy->loc = loc;
+  copy->size = size;
+  copy->stride = 0;
+  copy->length = size;
+  copy->dir = dir;
+
+  __cl_dma_large_start(copy);
+}
+
+void pi_cl_dma_memcpy_2d_large(uint32_t ext, uint32_t loc, uint32_t size, uint32_t stride, uint32_t length, pi_cl_dma_dir_e dir, pi_cl_dma_large_t *copy)
+{
+  copy->ext = ext;
+  copy->loc = loc;
+  copy->size = size;
+  copy->stride = stride;
+  copy->length = length;
+  copy->dir = dir;
+
+  __cl_dma_large_start(copy);
+}
+
+void pi_cl_dma_large_wait(pi_cl_dma_large_t *copy)
+{
+  // Batches are finished in order, so waiting for the oldest one and then
+  // reusing its slot for the next batch keeps one batch always queued
+  while (copy->ids[copy->current] != -1)
+  {
+    __cl_dma_counter_wait(copy->ids[copy->current]);
+    copy->ids[copy->current] = -1;
+
+    if (copy->size)
+      __cl_dma_large_push(copy, copy->current);
+
+    copy->current ^= 1;
+  }
+}
+
+void pi_cl_dma_cmd_nd(pi_cl_dma_nd_t *desc, pi_cl_dma_cmd_t *copy)
+{
+  uint32_t size[PI_CL_DMA_MAX_DIMS];
+  uint32_t stride[PI_CL_DMA_MAX_DIMS];
+  uint32_t index[PI_CL_DMA_MAX_DIMS];
+  int nb_dims = 1;
+
+  // Merge the dimensions which are contiguous with the previous one, so that
+  // each command moves as much data as possible
+  size[0] = desc->size[0];
+  stride[0] = 0;
+  for (int i=1; i<desc->nb_dims; i++)
+  {
+    if (nb_dims == 1 && desc->stride[i] == size[0])
+    {
+      size[0] *= desc->size[i];
+    }
+    else if (nb_dims > 1 && desc->stride[i] == stride[nb_dims-1] * size[nb_dims-1])
+    {
+      size[nb_dims-1] *= desc->size[i];
+    }
+    else
+    {
+      size[nb_dims] = desc->size[i];
+      stride[nb_dims] = desc->stride[i];
+      index[nb_dims] = 0;
+      nb_dims++;
+    }
+  }
+
+  pi_cl_dma_large_t block;
+  block.dir = desc->dir;
+  block.length = size[0];
+  block.stride = nb_dims > 1 ? stride[1] : 0;
+
+  uint32_t ext = desc->ext;
+  uint32_t loc = desc->loc;
+  uint32_t block_size = size[0] * (nb_dims > 1 ? size[1] : 1);
+
+  int lock = __cl_dma_lock();
+
+  copy->id = __cl_dma_counter_alloc();
+  copy->length = 0;
+
+  // Prevent the compiler from pushing the transfer before all previous
+  // stores are done
+  __asm__ __volatile__ ("" : : : "memory");
+
+  while(1)
+  {
+    block.ext = ext;
+    block.loc = loc;
+    block.size = block_size;
+    block.line_pos = 0;
+
+    while (block.size)
+    {
+      __cl_dma_large_push_cmd(&block);
+    }
+
+    loc += block_size;
+
+    // Move to the next 2D block by incrementing the outer dimensions
+    int dim;
+    for (dim=2; dim<nb_dims; dim++)
+    {
+      ext += stride[dim];
+      if (++index[dim] < size[dim])
+        break;
+
+      ext -= stride[dim] * size[dim];
+      index[dim] = 0;
+    }
+
+    if (dim >= nb_dims)
+      break;
+  }
+
+  __cl_dma_unlock(lock);
+}
+
+void pi_cl_dma_cmd_sg(pi_cl_dma_sg_entry_t *entries, int nb_entries, pi_cl_dma_dir_e dir, pi_cl_dma_cmd_t *copy)
+{
+  pi_cl_dma_large_t block;
+  block.dir = dir;
+
+  int lock = __cl_dma_lock();
+
+  copy->id = __cl_dma_counter_alloc();
+  copy->length = 0;
+
+  // Prevent the compiler from pushing the transfer before all previous
+  // stores are done
+  __asm__ __volatile__ ("" : : : "memory");
+
+  for (int i=0; i<nb_entries; i++)
+  {
+    pi_cl_dma_sg_entry_t *entry = &entries[i];
+
+    block.ext = entry->ext;
+    block.loc = entry->loc;
+    block.size = entry->size;
+    block.stride = entry->stride;
+    block.length = entry->stride ? entry->length : entry->size;
+    block.line_pos = 0;
+
+    while (block.size)
+    {
+      __cl_dma_large_push_cmd(&block);
+    }
+  }
+
+  __cl_dma_unlock(lock);
+}
+
+static void __cl_dma_pipe_tile(pi_cl_dma_tile_t *tile, uint32_t loc, pi_cl_dma_dir_e dir, pi_cl_dma_cmd_t *cmd)
+{
+  // The size of a single command is limited, bigger tiles are split into
+  // several commands attached to the same counter
+  if (tile->size > PI_CL_DMA_LARGE_BURST_SIZE || tile->stride >= __CL_DMA_MAX_2D_STRIDE)
+  {
+    pi_cl_dma_sg_entry_t entry;
+    entry.ext = tile->ext;
+    entry.loc = loc;
+    entry.size = tile->size;
+    entry.stride = tile->stride;
+    entry.length = tile->length;
+    pi_cl_dma_cmd_sg(&entry, 1, dir, cmd);
+  }
+  else if (tile->stride)
+    pi_cl_dma_cmd_2d(tile->ext, loc, tile->size, tile->stride, tile->length, dir, cmd);
+  else
+    pi_cl_dma_cmd(tile->ext, loc, tile->size, dir, cmd);
+}
+
+static uint32_t __cl_dma_pipe_max_size(pi_cl_dma_tile_t *tiles, int nb_tiles)
+{
+  uint32_t max = 0;
+
+  if (tiles)
+  {
+    for (int i=0; i<nb_tiles; i++)
+    {
+      if (tiles[i].size > max)
+        max = tiles[i].size;
+    }
+  }
+
+  // Keep the slots word-aligned
+  return (max + 3) & ~3;
+}
+
+static void __cl_dma_pipe_compute(void *arg)
+{
+  pi_cl_dma_pipe_t *pipe = (pi_cl_dma_pipe_t *)arg;
+  pipe->compute(pipe->current_in, pipe->current_out, pipe->current_tile, pipe->arg);
+}
+
+int pi_cl_dma_pipe_run(pi_cl_dma_pipe_t *pipe)
+{
+  pi_cl_dma_cmd_t in_cmd[PI_CL_DMA_PIPE_MAX_BUFFERS];
+  pi_cl_dma_cmd_t out_cmd[PI_CL_DMA_PIPE_MAX_BUFFERS];
+  uint32_t in_size = __cl_dma_pipe_max_size(pipe->in, pipe->nb_tiles);
+  uint32_t out_size = __cl_dma_pipe_max_size(pipe->out, pipe->nb_tiles);
+  uint32_t slot_size = in_size + out_size;
+  int nb_tiles = pipe->nb_tiles;
+  unsigned int start;
+
+  if (slot_size == 0 || pipe->buffer_size < slot_size)
+    return -1;
+
+  int nb_buffers = pipe->buffer_size / slot_size;
+  if (nb_buffers > PI_CL_DMA_PIPE_MAX_BUFFERS)
+    nb_buffers = PI_CL_DMA_PIPE_MAX_BUFFERS;
+
+  pipe->nb_buffers = nb_buffers;
+  pipe->in_wait_cycles = 0;
+  pipe->out_wait_cycles = 0;
+  pipe->compute_cycles = 0;
+
+  uint32_t buffer = (uint32_t)pipe->buffer;
+
+  // Prefetch the inputs of the first tiles, the last slot is filled at the
+  // beginning of the first iteration
+  for (int i=0; i<nb_buffers-1 && i<nb_tiles; i++)
+  {
+    if (pipe->in)
+      __cl_dma_pipe_tile(&pipe->in[i], buffer + i*slot_size, PI_CL_DMA_DIR_EXT2LOC, &in_cmd[i]);
+  }
+
+  for (int i=0; i<nb_tiles; i++)
+  {
+    int slot = i % nb_buffers;
+    uint32_t slot_in = buffer + slot*slot_size;
+    uint32_t slot_out = slot_in + in_size;
+
+    // The slot of the tile in nb_buffers-1 tiles is the one of the previous
+    // tile, whose input is no longer used
+    int next = i + nb_buffers - 1;
+    if (pipe->in && next < nb_tiles)
+    {
+      int next_slot = next % nb_buffers;
+      __cl_dma_pipe_tile(&pipe->in[next], buffer + next_slot*slot_size, PI_CL_DMA_DIR_EXT2LOC, &in_cmd[next_slot]);
+    }
+
+    if (pipe->in)
+    {
+      start = pi_perf_read(PI_PERF_CYCLES);
+      pi_cl_dma_cmd_wait(&in_cmd[slot]);
+      pipe->in_wait_cycles += pi_perf_read(PI_PERF_CYCLES) - start;
+    }
+
+    // The output area of this slot may still be written back for the tile
+    // which used it before
+    if (pipe->out && i >= nb_buffers)
+    {
+      start = pi_perf_read(PI_PERF_CYCLES);
+      pi_cl_dma_cmd_wait(&out_cmd[slot]);
+      pipe->out_wait_cycles += pi_perf_read(PI_PERF_CYCLES) - start;
+    }
+
+    pipe->current_in = (void *)slot_in;
+    pipe->current_out = (void *)slot_out;
+    pipe->current_tile = i;
+
+    start = pi_perf_read(PI_PERF_CYCLES);
+    rt_team_fork(pipe->nb_cores, __cl_dma_pipe_compute, (void *)pipe);
+    pipe->compute_cycles += pi_perf_read(PI_PERF_CYCLES) - start;
+
+    if (pipe->out)
+      __cl_dma_pipe_tile(&pipe->out[i], slot_out, PI_CL_DMA_DIR_LOC2EXT, &out_cmd[slot]);
+  }
+
+  if (pipe->out)
+  {
+    start = pi_perf_read(PI_PERF_CYCLES);
+    int first = nb_tiles > nb_buffers ? nb_tiles - nb_buffers : 0;
+    for (int i=first; i<nb_tiles; i++)
+    {
+      pi_cl_dma_cmd_wait(&out_cmd[i % nb_buffers]);
+    }
+    pipe->out_wait_cycles += pi_perf_read(PI_PERF_CYCLES) - start;
+  }
+
+  return 0;
+}
+
+static void __cl_dma_pipe_plan_tile(pi_cl_dma_tile_t *tile, uint32_t ext, uint32_t width, uint32_t elem_size, uint32_t pos[2], uint32_t size[2])
+{
+  uint32_t length = size[0] * elem_size;
+
+  tile->ext = ext + (pos[1] * width + pos[0]) * elem_size;
+  tile->size = length * size[1];
+  tile->length = length;
+  tile->stride = size[0] == width ? 0 : width * elem_size;
+}
+
+int pi_cl_dma_pipe_plan(pi_cl_dma_pipe_t *pipe, pi_tile_plan_t *plan, uint32_t in, uint32_t out, pi_cl_dma_tile_t *in_tiles, pi_cl_dma_tile_t *out_tiles)
+{
+  // The pipeline only handles one input and one output stream, with at
+  // most PI_CL_DMA_PIPE_MAX_BUFFERS buffers
+  if (plan->dims[2] > 1 || plan->nb_inputs != 1 || plan->nb_outputs != 1 || plan->depth > PI_CL_DMA_PIPE_MAX_BUFFERS)
+    return -1;
+
+  int nb_tiles = plan->nb_tiles[0] * plan->nb_tiles[1];
+
+  for (int i=0; i<nb_tiles; i++)
+  {
+    uint32_t pos[3], size[3];
+
+    pi_tile_plan_coords(plan, i, pos, size);
+
+    __cl_dma_pipe_plan_tile(&out_tiles[i], out, plan->dims[0], plan->elem_size, pos, size);
+
+    // Extend the input tile with the halo, without crossing the tensor
+    // boundaries
+    for (int j=0; j<2; j++)
+    {
+      uint32_t start = pos[j] > plan->halo[j] ? pos[j] - plan->halo[j] : 0;
+      uint32_t end = pos[j] + size[j] + plan->halo[j];
+      if (end > plan->dims[j])
+        end = plan->dims[j];
+
+      pos[j] = start;
+      size[j] = end - start;
+    }
+
+    __cl_dma_pipe_plan_tile(&in_tiles[i], in, plan->dims[0], plan->elem_size, pos, size);
+  }
+
+  pipe->in = in_tiles;
+  pipe->out = out_tiles;
+  pipe->nb_tiles = nb_tiles;
+
+  return 0;
+}
+
+#endif
@@ -9,7 +9,7 @@ endif
 
 PULP_LIB_FC_SRCS_rt     += kernel/init.c \
    kernel/dev.c kernel/irq.c kernel/debug.c \
-  kernel/utils.c kernel/error.c kernel/bridge.c kernel/conf.c
+  kernel/utils.c kernel/error.c kernel/bridge.c kernel/conf.c kernel/memcpy.c kernel/buf.c kernel/prefetch.c
 PULP_LIB_FC_ASM_SRCS_rt += kernel/$(fc_archi)/thread.S
 
 PULP_CFLAGS     += -D__RT_USE_BRIDGE=1
@@ -18,6 +18,10 @@ ifdef CONFIG_WARNING_ENABLED
 PULP_CFLAGS     += -D__RT_USE_WARNING=1
 endif
 
+ifdef CONFIG_DMA_PROFILE_ENABLED
+PULP_CFLAGS     += -D__RT_USE_DMA_PROFILE=1
+endif
+
 ifneq '$(cluster/version)' ''
 PULP_LIB_FC_SRCS_rt     += kernel/task.c
 PULP_LIB_FC_ASM_SRCS_rt += kernel/$(fc_archi)/task.S
@@ -154,7 +158,7 @@ PULP_LIB_FC_SRCS_rt     += kernel/vivosoc4/freq.c
 endif
 
 
-PULP_LIB_FC_SRCS_rt += kernel/cluster.c kernel/pulpos_emu.c
+PULP_LIB_FC_SRCS_rt += kernel/cluster.c kernel/pulpos_emu.c kernel/tile.c
 
 ifneq '$(cluster/version)' ''
 PULP_CFLAGS += -D__RT_CLUSTER_ASM
@@ -171,6 +175,10 @@ PULP_LIB_CL_SRCS_rt += kernel/sync_mc.c
 endif
 endif
 
+ifneq '$(cluster/version)' ''
+PULP_LIB_CL_SRCS_rt += kernel/dma.c
+endif
+
 ifeq '$(pulp_chip_family)' 'pulpissimo'
 PULP_LIB_FC_SRCS_rt += kernel/pulpissimo/pulpissimo.c	
 endif
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rt/rt_api.h"
+
+typedef enum
+{
+  __RT_FC_COPY_MEMCPY,
+  __RT_FC_COPY_MEMSET
+} __rt_fc_copy_op_e;
+
+static pi_task_t *__rt_fc_copy_first;
+static pi_task_t *__rt_fc_copy_last;
+static pi_task_t __rt_fc_copy_event;
+
+void __rt_memcpy_fast(void *dst0, const void *src0, uint32_t size)
+{
+  uint8_t *dst = (uint8_t *)dst0;
+  const uint8_t *src = (const uint8_t *)src0;
+
+  if ((((uint32_t)dst ^ (uint32_t)src) & 3) == 0)
+  {
+    // Same alignment on both sides, copy bytes until they are aligned and
+    // then full words
+    while (size && ((uint32_t)dst & 3))
+    {
+      *dst++ = *src++;
+      size--;
+    }
+
+    while (size >= 16)
+    {
+      uint32_t w0 = ((uint32_t *)src)[0];
+      uint32_t w1 = ((uint32_t *)src)[1];
+      uint32_t w2 = ((uint32_t *)src)[2];
+      uint32_t w3 = ((uint32_t *)src)[3];
+      ((uint32_t *)dst)[0] = w0;
+      ((uint32_t *)dst)[1] = w1;
+      ((uint32_t *)dst)[2] = w2;
+      ((uint32_t *)dst)[3] = w3;
+      dst += 16;
+      src += 16;
+      size -= 16;
+    }
+
+    while (size >= 4)
+    {
+      *(uint32_t *)dst = *(uint32_t *)src;
+      dst += 4;
+      src += 4;
+      size -= 4;
+    }
+  }
+  else if ((((uint32_t)dst ^ (uint32_t)src) & 1) == 0)
+  {
+    if (size && ((uint32_t)dst & 1))
+    {
+      *dst++ = *src++;
+      size--;
+    }
+
+    while (size >= 2)
+    {
+      *(uint16_t *)dst = *(uint16_t *)src;
+      dst += 2;
+      src += 2;
+      size -= 2;
+    }
+  }
+
+  while (size)
+  {
+    *dst++ = *src++;
+    size--;
+  }
+}
+
+void __rt_memset_fast(void *dst0, int value, uint32_t size)
+{
+  uint8_t *dst = (uint8_t *)dst0;
+  uint32_t word = (value & 0xff) * 0x01010101;
+
+  while (size && ((uint32_t)dst & 3))
+  {
+    *dst++ = value;
+    size--;
+  }
+
+  while (size >= 16)
+  {
+    ((uint32_t *)dst)[0] = word;
+    ((uint32_t *)dst)[1] = word;
+    ((uint32_t *)dst)[2] = word;
+    ((uint32_t *)dst)[3] = word;
+    dst += 16;
+    size -= 16;
+  }
+
+  while (size >= 4)
+  {
+    *(uint32_t *)dst = word;
+    dst += 4;
+    size -= 4;
+  }
+
+  while (size)
+  {
+    *dst++ = value;
+    size--;
+  }
+}
+
+// Executes one chunk of the first request, and enqueue itself again to the
+// scheduler tail if there is still work to do, so that the other events are
+// not delayed more than the time of one chunk.
+static void __rt_fc_copy_handle(void *arg)
+{
+  int irq = rt_irq_disable();
+
+  pi_task_t *task = __rt_fc_copy_first;
+
+  rt_irq_restore(irq);
+
+  uint32_t dst = task->implem.data[1];
+  uint32_t src = task->implem.data[2];
+  uint32_t size = task->implem.data[3];
+  uint32_t chunk = size > PI_FC_COPY_CHUNK_SIZE ? PI_FC_COPY_CHUNK_SIZE : size;
+
+  if (task->implem.data[0] == __RT_FC_COPY_MEMCPY)
+  {
+    __rt_memcpy_fast((void *)dst, (void *)src, chunk);
+    task->implem.data[2] = src + chunk;
+  }
+  else
+  {
+    __rt_memset_fast((void *)dst, src, chunk);
+  }
+
+  task->implem.data[1] = dst + chunk;
+  task->implem.data[3] = size - chunk;
+
+  irq = rt_irq_disable();
+
+  if (size == chunk)
+  {
+    __rt_fc_copy_first = task->implem.next;
+    __rt_event_enqueue(task);
+  }
+
+  if (__rt_fc_copy_first)
+    __rt_event_enqueue(&__rt_fc_copy_event);
+
+  rt_irq_restore(irq);
+}
+
+static void __rt_fc_copy_enqueue(pi_task_t *task, __rt_fc_copy_op_e op, uint32_t dst, uint32_t src, uint32_t size)
+{
+  __rt_task_init(task);
+
+  int irq = rt_irq_disable();
+
+  // Small requests are done immediately if nothing is pending, as the
+  // scheduling would cost more than the copy itself
+  if (__rt_fc_copy_first == NULL && size <= PI_FC_COPY_SYNC_SIZE)
+  {
+    if (op == __RT_FC_COPY_MEMCPY)
+      __rt_memcpy_fast((void *)dst, (void *)src, size);
+    else
+      __rt_memset_fast((void *)dst, src, size);
+
+    __rt_event_enqueue(task);
+    goto end;
+  }
+
+  task->implem.data[0] = op;
+  task->implem.data[1] = dst;
+  task->implem.data[2] = src;
+  task->implem.data[3] = size;
+  task->implem.next = NULL;
+
+  if (__rt_fc_copy_first)
+  {
+    __rt_fc_copy_last->implem.next = task;
+  }
+  else
+  {
+    __rt_fc_copy_first = task;
+
+    __rt_init_event(&__rt_fc_copy_event, rt_event_internal_sched(), __rt_fc_copy_handle, NULL);
+    __rt_event_set_keep(&__rt_fc_copy_event);
+    __rt_event_enqueue(&__rt_fc_copy_event);
+  }
+
+  __rt_fc_copy_last = task;
+
+end:
+  rt_irq_restore(irq);
+}
+
+void pi_fc_memcpy_async(void *dst, const void *src, uint32_t size, pi_task_t *task)
+{
+  __rt_fc_copy_enqueue(task, __RT_FC_COPY_MEMCPY, (uint32_t)dst, (uint32_t)src, size);
+}
+
+void pi_fc_memset_async(void *dst, int value, uint32_t size, pi_task_t *task)
+{
+  __rt_fc_copy_enqueue(task, __RT_FC_COPY_MEMSET, (uint32_t)dst, (uint32_t)value, size);
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rt/rt_api.h"
+
+// The buffers of the ring are used in order: first the ones acquired by the
+// application, then the ready ones, then the ones being read and then the
+// free ones.
+
+static void __pi_prefetch_read_done(void *arg);
+
+static inline int __pi_prefetch_index(pi_prefetch_t *prefetch, int index)
+{
+  return index >= prefetch->nb_buffers ? index - prefetch->nb_buffers : index;
+}
+
+
+
+static void __pi_prefetch_fill(pi_prefetch_t *prefetch)
+{
+  while (prefetch->nb_inflight < prefetch->nb_inflight_max && prefetch->next_addr < prefetch->end_addr)
+  {
+    int used = prefetch->nb_acquired + prefetch->nb_ready + prefetch->nb_inflight;
+    if (used == prefetch->nb_buffers)
+      return;
+
+    int index = __pi_prefetch_index(prefetch, prefetch->first + used);
+    uint32_t size = prefetch->end_addr - prefetch->next_addr;
+    if (size > prefetch->block_size)
+      size = prefetch->block_size;
+
+    // Reads finish in order, so the tasks can be used in a round-robin way
+    pi_task_t *task = &prefetch->tasks[prefetch->current_task];
+    prefetch->current_task++;
+    if (prefetch->current_task == prefetch->nb_inflight_max)
+      prefetch->current_task = 0;
+
+    pi_task_callback(task, __pi_prefetch_read_done, (void *)prefetch);
+    prefetch->read(prefetch->dev, prefetch->next_addr, prefetch->buffers + index * prefetch->block_size, size, task);
+
+    prefetch->next_addr += size;
+    prefetch->nb_inflight++;
+  }
+}
+
+
+
+// Gives the oldest ready block to the task, or the end of the area
+static void __pi_prefetch_give(pi_prefetch_t *prefetch, pi_task_t *task)
+{
+  if (prefetch->nb_ready == 0)
+  {
+    task->implem.data[0] = 0;
+    task->implem.data[1] = 0;
+  }
+  else
+  {
+    int index = __pi_prefetch_index(prefetch, prefetch->first + prefetch->nb_acquired);
+    uint32_t size = prefetch->end_addr - prefetch->ready_addr;
+    if (size > prefetch->block_size)
+      size = prefetch->block_size;
+
+    task->implem.data[0] = (uint32_t)(prefetch->buffers + index * prefetch->block_size);
+    task->implem.data[1] = size;
+
+    prefetch->ready_addr += size;
+    prefetch->nb_ready--;
+    prefetch->nb_acquired++;
+  }
+
+  __rt_event_enqueue(task);
+}
+
+
+
+static inline int __pi_prefetch_is_over(pi_prefetch_t *prefetch)
+{
+  return prefetch->ready_addr == prefetch->end_addr;
+}
+
+
+
+static void __pi_prefetch_read_done(void *arg)
+{
+  pi_prefetch_t *prefetch = (pi_prefetch_t *)arg;
+  int irq = rt_irq_disable();
+
+  prefetch->nb_inflight--;
+  prefetch->nb_ready++;
+
+  // Also notify the end of the area to all the remaining waiting tasks when
+  // the last block is given
+  pi_task_t *task;
+  while ((task = prefetch->waiting_first) && (prefetch->nb_ready || __pi_prefetch_is_over(prefetch)))
+  {
+    prefetch->waiting_first = task->implem.next;
+    __pi_prefetch_give(prefetch, task);
+  }
+
+  __pi_prefetch_fill(prefetch);
+
+  rt_irq_restore(irq);
+}
+
+
+
+int pi_prefetch_start(pi_prefetch_t *prefetch,
+  void (*read)(void *dev, uint32_t ext_addr, void *addr, uint32_t size, pi_task_t *task), void *dev,
+  uint32_t ext_addr, uint32_t size, void *buffers, uint32_t block_size, int nb_buffers, int nb_inflight)
+{
+  if (nb_inflight < 1 || nb_inflight > PI_PREFETCH_MAX_INFLIGHT || nb_buffers < 1 || nb_buffers > 255 || block_size == 0)
+    return -1;
+
+  prefetch->read = read;
+  prefetch->dev = dev;
+  prefetch->buffers = (char *)buffers;
+  prefetch->block_size = block_size;
+  prefetch->next_addr = ext_addr;
+  prefetch->ready_addr = ext_addr;
+  prefetch->end_addr = ext_addr + size;
+  prefetch->nb_buffers = nb_buffers;
+  prefetch->nb_inflight_max = nb_inflight;
+  prefetch->first = 0;
+  prefetch->nb_acquired = 0;
+  prefetch->nb_ready = 0;
+  prefetch->nb_inflight = 0;
+  prefetch->current_task = 0;
+  prefetch->waiting_first = NULL;
+
+  int irq = rt_irq_disable();
+  __pi_prefetch_fill(prefetch);
+  rt_irq_restore(irq);
+
+  return 0;
+}
+
+
+
+void pi_prefetch_acquire_async(pi_prefetch_t *prefetch, pi_task_t *task)
+{
+  int irq = rt_irq_disable();
+
+  __rt_task_init(task);
+
+  if (prefetch->nb_ready || (prefetch->waiting_first == NULL && __pi_prefetch_is_over(prefetch)))
+  {
+    __pi_prefetch_give(prefetch, task);
+  }
+  else
+  {
+    if (prefetch->waiting_first)
+      prefetch->waiting_last->implem.next = task;
+    else
+      prefetch->waiting_first = task;
+
+    task->implem.next = NULL;
+    prefetch->waiting_last = task;
+  }
+
+  rt_irq_restore(irq);
+}
+
+
+
+void pi_prefetch_release(pi_prefetch_t *prefetch)
+{
+  int irq = rt_irq_disable();
+
+  if (prefetch->nb_acquired)
+  {
+    prefetch->nb_acquired--;
+    prefetch->first = __pi_prefetch_index(prefetch, prefetch->first + 1);
+    __pi_prefetch_fill(prefetch);
+  }
+
+  rt_irq_restore(irq);
+}
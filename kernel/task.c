@@ -38,6 +38,9 @@ RT_L1_TINY_DATA rt_task_t *__rt_task_first_cl;
 // Last task to be handled which was pushed from cluster side
 RT_L1_TINY_DATA rt_task_t *__rt_task_last_cl;
 
+// Per-core deques for single core tasks pushed from cluster side
+RT_L1_TINY_DATA rt_task_deque_t __rt_task_deques[ARCHI_CLUSTER_NB_PE];
+
 void __rt_task_master_entry(void *arg);
 
 
@@ -104,6 +107,12 @@ int rt_task_cluster_init(rt_task_cluster_t *cluster, rt_task_conf_t *conf, rt_ev
   cluster_loc->__rt_task_first_fc = NULL;
   cluster_loc->__rt_task_last_fc = NULL;
   *(int *)rt_cluster_tiny_addr(cid, &__rt_task_first_cl) = 0;
+  rt_task_deque_t *deques = (rt_task_deque_t *)rt_cluster_tiny_addr(cid, __rt_task_deques);
+  for (int i=0; i<ARCHI_CLUSTER_NB_PE; i++)
+  {
+    deques[i].top = 0;
+    deques[i].bottom = 0;
+  }
   cluster_loc->__rt_task_first_fc_for_cl = NULL;
 
   cluster->end_event = rt_event_get_blocking(NULL);
@@ -161,6 +170,11 @@ void rt_task_cluster_deinit(rt_task_cluster_t *cluster, rt_event_t *event)
   }
   rt_irq_disable();
 
+  // The cores left the task framework by restarting from scratch instead of
+  // returning from the cluster call, so its end is not seen by the idle
+  // power-gating
+  __rt_cluster_activity_end(&__rt_fc_cluster_data[cluster->cid]);
+
   // Now free all allocated resources
   if (cluster->free_stacks)
   {
@@ -277,6 +291,22 @@ void rt_task_cl_push(rt_task_t *task)
 
   eu_mutex_lock_from_id(0);
 
+  // Single core tasks are pushed to the deque of the calling core, where
+  // they will be popped in LIFO order by this core, or stolen in FIFO order
+  // by idle cores. Multi-core tasks must be seen by several cores and thus
+  // go to the shared queue, as well as tasks overflowing the deque.
+  int core_id = rt_core_id();
+  if (task->nb_cores == 0 && core_id < ARCHI_CLUSTER_NB_PE)
+  {
+    rt_task_deque_t *deque = &__rt_task_deques[core_id];
+    if (deque->bottom - deque->top < RT_TASK_DEQUE_SIZE)
+    {
+      deque->tasks[deque->bottom & (RT_TASK_DEQUE_SIZE - 1)] = task;
+      deque->bottom++;
+      goto end;
+    }
+  }
+
   if (__rt_task_first_cl)
   {
     __rt_task_last_cl->next = task;
@@ -288,6 +318,7 @@ void rt_task_cl_push(rt_task_t *task)
 
   __rt_task_last_cl = task;
 
+end:
   eu_mutex_unlock_from_id(0);
 
   eu_evt_trig_from_id(RT_CLUSTER_CALL_EVT, 0);
@@ -303,4 +334,144 @@ void rt_task_cl_wait(rt_task_t *task)
   eu_evt_maskClr(1<<RT_CLUSTER_CALL_EVT);
 }
 
+
+
+void pi_cluster_graph_init(pi_cluster_graph_t *graph)
+{
+  graph->first = NULL;
+  graph->last = NULL;
+  graph->nb_nodes = 0;
+  graph->nb_done = 0;
+}
+
+
+
+void pi_cluster_graph_node_add(pi_cluster_graph_t *graph, pi_cluster_graph_node_t *node, struct pi_cluster_task *task)
+{
+  node->task = task;
+  node->nb_succs = 0;
+  node->nb_preds = 0;
+  node->next = NULL;
+
+  if (graph->last)
+    graph->last->next = node;
+  else
+    graph->first = node;
+
+  graph->last = node;
+  graph->nb_nodes++;
+}
+
+
+
+int pi_cluster_graph_edge_add(pi_cluster_graph_node_t *from, pi_cluster_graph_node_t *to)
+{
+  if (from->nb_succs == RT_CLUSTER_GRAPH_NODE_MAX_SUCCS)
+    return -1;
+
+  from->succs[from->nb_succs++] = to;
+  to->nb_preds++;
+
+  return 0;
+}
+
+
+
+// Executed by the cluster master core. The graph is walked in topological
+// order using a LIFO of ready nodes, so that a node whose dependencies have
+// just been satisfied by the previous one is executed next, while its
+// input data are still hot.
+static void __rt_cluster_graph_entry(void *arg)
+{
+  pi_cluster_graph_t *graph = (pi_cluster_graph_t *)arg;
+  pi_cluster_graph_node_t *ready = NULL;
+  int nb_done = 0;
+
+  for (pi_cluster_graph_node_t *node = graph->first; node; node = node->next)
+  {
+    node->pending_preds = node->nb_preds;
+    if (node->nb_preds == 0)
+    {
+      node->next_ready = ready;
+      ready = node;
+    }
+  }
+
+  while (ready)
+  {
+    pi_cluster_graph_node_t *node = ready;
+    ready = node->next_ready;
+
+    node->task->entry(node->task->arg);
+    nb_done++;
+
+    for (int i=0; i<node->nb_succs; i++)
+    {
+      pi_cluster_graph_node_t *succ = node->succs[i];
+      if (--succ->pending_preds == 0)
+      {
+        succ->next_ready = ready;
+        ready = succ;
+      }
+    }
+  }
+
+  // If there is a cycle, some nodes are never ready. This can be checked by
+  // the FC by comparing with the number of nodes.
+  graph->nb_done = nb_done;
+}
+
+
+
+int pi_cluster_graph_send_async(struct pi_device *device, pi_cluster_graph_t *graph, pi_task_t *task)
+{
+  struct pi_cluster_task *graph_task = &graph->task;
+  int stack_size = 0;
+  int slave_stack_size = 0;
+  int nb_cores = 0;
+
+  // All nodes are executed within the same cluster task, so it must get
+  // the biggest requirements.
+  for (pi_cluster_graph_node_t *node = graph->first; node; node = node->next)
+  {
+    struct pi_cluster_task *node_task = node->task;
+
+    if (node_task->stack_size > stack_size)
+      stack_size = node_task->stack_size;
+
+    if (node_task->slave_stack_size > slave_stack_size)
+      slave_stack_size = node_task->slave_stack_size;
+
+    if (node_task->nb_cores == 0)
+      nb_cores = pi_cl_cluster_nb_cores();
+    else if (node_task->nb_cores > nb_cores)
+      nb_cores = node_task->nb_cores;
+  }
+
+  pi_cluster_task(graph_task, __rt_cluster_graph_entry, graph);
+  graph_task->stack_size = stack_size;
+  graph_task->slave_stack_size = slave_stack_size;
+  graph_task->nb_cores = nb_cores;
+
+  graph->nb_done = 0;
+
+  return pi_cluster_send_task_to_cl_async(device, graph_task, task);
+}
+
+
+
+int pi_cluster_graph_send(struct pi_device *device, pi_cluster_graph_t *graph)
+{
+  pi_task_t task;
+
+  pi_task_block(&task);
+
+  if (pi_cluster_graph_send_async(device, graph, &task))
+    return -1;
+
+  pi_task_wait_on(&task);
+
+  return graph->nb_done == graph->nb_nodes ? 0 : -1;
+}
+
 #endif
\ No newline at end of file
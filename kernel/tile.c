@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This file must only depend on the C library so that the planner can be
+// compiled on the host.
+#include "rt/rt_tile.h"
+
+static inline uint32_t __tile_div_up(uint32_t value, uint32_t div)
+{
+  return (value + div - 1) / div;
+}
+
+// The DMA pipeline keeps its slots word-aligned
+static inline uint32_t __tile_align(uint32_t size)
+{
+  return (size + 3) & ~3;
+}
+
+// Gives the same size to all tiles of a dimension, for the same number of
+// tiles, so that the last one is not much smaller than the others
+static inline uint32_t __tile_balance(uint32_t dim, uint32_t tile)
+{
+  return __tile_div_up(dim, __tile_div_up(dim, tile));
+}
+
+int pi_tile_plan(pi_tile_plan_t *plan)
+{
+  uint32_t w = plan->dims[0];
+  uint32_t h = plan->dims[1];
+  uint32_t c = plan->dims[2] ? plan->dims[2] : 1;
+  uint32_t hx = plan->halo[0] * 2;
+  uint32_t hy = plan->halo[1] * 2;
+  uint32_t e = plan->elem_size;
+  uint32_t nb_in = plan->nb_inputs;
+  uint32_t nb_out = plan->nb_outputs;
+  uint32_t depth = plan->depth ? plan->depth : 1;
+  uint32_t slot_budget = plan->budget / depth;
+  uint64_t best_cost = (uint64_t)-1;
+  uint32_t prev_tw = 0;
+
+  if (w == 0 || h == 0 || e == 0 || nb_in + nb_out == 0)
+    return -1;
+
+  // Only the distinct tile widths are tried, as for a given number of tiles
+  // in a dimension, the balanced tile size is always the same
+  for (uint32_t nx=1; nx<=w; nx++)
+  {
+    uint32_t tw = __tile_div_up(w, nx);
+    if (tw == prev_tw)
+      continue;
+    prev_tw = tw;
+
+    uint32_t prev_tc = 0;
+
+    for (uint32_t nc=1; nc<=c; nc++)
+    {
+      uint32_t tc = __tile_div_up(c, nc);
+      if (tc == prev_tc)
+        continue;
+      prev_tc = tc;
+
+      // Solve the biggest tile height fitting in one slot:
+      //   ((tw+hx)*(th+hy)*nb_in + tw*th*nb_out) * tc * e <= slot_budget
+      uint32_t line_bytes = ((tw + hx) * nb_in + tw * nb_out) * tc * e;
+      uint32_t halo_bytes = (tw + hx) * hy * nb_in * tc * e;
+      if (slot_budget < halo_bytes + line_bytes)
+        continue;
+
+      uint32_t th = (slot_budget - halo_bytes) / line_bytes;
+      if (th > h)
+        th = h;
+      th = __tile_balance(h, th);
+
+      // The alignment of the buffers can make the solved height slightly
+      // too big, in which case it is reduced until the slot fits
+      uint32_t in_bytes, out_bytes, in_size, out_size;
+      while (1)
+      {
+        in_bytes = (tw + hx) * (th + hy) * tc * e;
+        out_bytes = tw * th * tc * e;
+        in_size = __tile_align(in_bytes);
+        out_size = __tile_align(out_bytes);
+        if (in_size * nb_in + out_size * nb_out <= slot_budget || th == 1)
+          break;
+        th = __tile_balance(h, th - 1);
+      }
+
+      if (in_size * nb_in + out_size * nb_out > slot_budget)
+        continue;
+
+      uint32_t ny = __tile_div_up(h, th);
+      uint32_t nb_tiles = __tile_div_up(w, tw) * ny * __tile_div_up(c, tc);
+
+      // Lines are merged by the DMA when they are contiguous in the tensor
+      uint32_t in_lines, out_lines;
+      if (tw == w && hx == 0)
+      {
+        in_lines = th == h && hy == 0 ? 1 : tc;
+        out_lines = th == h ? 1 : tc;
+      }
+      else
+      {
+        in_lines = (th + hy) * tc;
+        out_lines = th * tc;
+      }
+
+      uint64_t transfered = (uint64_t)nb_tiles * (in_bytes * nb_in + out_bytes * nb_out);
+      uint64_t cost = transfered +
+        (uint64_t)nb_tiles * ((in_lines * nb_in + out_lines * nb_out) * PI_TILE_LINE_COST + PI_TILE_TILE_COST);
+
+      if (cost < best_cost)
+      {
+        best_cost = cost;
+        plan->tile[0] = tw;
+        plan->tile[1] = th;
+        plan->tile[2] = tc;
+        plan->nb_tiles[0] = __tile_div_up(w, tw);
+        plan->nb_tiles[1] = ny;
+        plan->nb_tiles[2] = __tile_div_up(c, tc);
+        plan->in_size = in_size;
+        plan->out_size = out_size;
+        plan->footprint = (in_size * nb_in + out_size * nb_out) * depth;
+        plan->transfered = transfered;
+      }
+    }
+  }
+
+  return best_cost == (uint64_t)-1 ? -1 : 0;
+}
+
+void pi_tile_plan_coords(pi_tile_plan_t *plan, int tile, uint32_t pos[3], uint32_t size[3])
+{
+  uint32_t dims[3] = { plan->dims[0], plan->dims[1], plan->dims[2] ? plan->dims[2] : 1 };
+
+  for (int i=0; i<3; i++)
+  {
+    uint32_t index = tile % plan->nb_tiles[i];
+    tile /= plan->nb_tiles[i];
+
+    pos[i] = index * plan->tile[i];
+    size[i] = dims[i] - pos[i] < plan->tile[i] ? dims[i] - pos[i] : plan->tile[i];
+  }
+}
+
+int pi_tile_plan_check(pi_tile_plan_t *plan)
+{
+  uint32_t nb_in = plan->nb_inputs;
+  uint32_t nb_out = plan->nb_outputs;
+  uint32_t depth = plan->depth ? plan->depth : 1;
+  uint32_t nb_tiles = plan->nb_tiles[0] * plan->nb_tiles[1] * plan->nb_tiles[2];
+  uint32_t in_max = 0, out_max = 0;
+
+  // Computes the tile sizes as the pipeline does, with the input halo
+  // clipped on the tensor boundaries
+  for (uint32_t i=0; i<nb_tiles; i++)
+  {
+    uint32_t pos[3], size[3];
+
+    pi_tile_plan_coords(plan, i, pos, size);
+
+    uint32_t out_bytes = size[0] * size[1] * size[2] * plan->elem_size;
+    uint32_t in_bytes = size[2] * plan->elem_size;
+
+    for (int j=0; j<2; j++)
+    {
+      uint32_t start = pos[j] > plan->halo[j] ? pos[j] - plan->halo[j] : 0;
+      uint32_t end = pos[j] + size[j] + plan->halo[j];
+      if (end > plan->dims[j])
+        end = plan->dims[j];
+
+      in_bytes *= end - start;
+    }
+
+    if (in_bytes > in_max)
+      in_max = in_bytes;
+    if (out_bytes > out_max)
+      out_max = out_bytes;
+  }
+
+  uint32_t slot_size = __tile_align(in_max) * nb_in + __tile_align(out_max) * nb_out;
+
+  if (__tile_align(in_max) > plan->in_size || __tile_align(out_max) > plan->out_size)
+    return -1;
+
+  if (slot_size * depth > plan->footprint || plan->footprint > plan->budget)
+    return -1;
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+#include "bench/bench.h"
+#include "stdio.h"
+
+#if defined(ARCHI_HAS_CLUSTER) && defined(ARCHI_HAS_FC)
+
+static void __bench_cluster_empty(void *arg)
+{
+}
+
+static unsigned int __bench_cycles_start()
+{
+  pi_perf_conf(1<<PI_PERF_CYCLES);
+  pi_perf_reset();
+  pi_perf_start();
+  return pi_perf_read(PI_PERF_CYCLES);
+}
+
+static unsigned int __bench_cycles_stop(unsigned int start)
+{
+  unsigned int end = pi_perf_read(PI_PERF_CYCLES);
+  pi_perf_stop();
+  return end - start;
+}
+
+static void __bench_cluster_print(char *name, unsigned int cycles, int nb_iter)
+{
+  unsigned int freq_mhz = pi_freq_get(PI_FREQ_DOMAIN_FC) / 1000000;
+  unsigned int per_iter = cycles / nb_iter;
+
+  printf("%s: %d cycles per offload", name, per_iter);
+  if (freq_mhz)
+    printf(" (%d ns)", per_iter * 1000 / freq_mhz);
+  printf("\n");
+}
+
+int bench_cluster_offload(int cid, int nb_iter)
+{
+  struct pi_device cluster_dev;
+  struct pi_cluster_conf conf;
+  struct pi_cluster_task task;
+  pi_cluster_worker_t worker;
+  unsigned int start, cycles;
+
+  pi_cluster_conf_init(&conf);
+  conf.id = cid;
+  pi_open_from_conf(&cluster_dev, &conf);
+  if (pi_cluster_open(&cluster_dev))
+    return -1;
+
+  // Warm-up so that stacks are allocated and icache is filled
+  pi_cluster_send_task_to_cl(&cluster_dev, pi_cluster_task(&task, __bench_cluster_empty, NULL));
+
+  start = __bench_cycles_start();
+  for (int i=0; i<nb_iter; i++)
+  {
+    pi_cluster_send_task_to_cl(&cluster_dev, pi_cluster_task(&task, __bench_cluster_empty, NULL));
+  }
+  cycles = __bench_cycles_stop(start);
+  __bench_cluster_print("pi_cluster_send_task_to_cl", cycles, nb_iter);
+
+  if (pi_cluster_worker_start(&cluster_dev, &worker, 0, 0, 0))
+  {
+    pi_cluster_close(&cluster_dev);
+    return -1;
+  }
+
+  pi_cluster_worker_send(&worker, __bench_cluster_empty, NULL);
+
+  start = __bench_cycles_start();
+  for (int i=0; i<nb_iter; i++)
+  {
+    pi_cluster_worker_send(&worker, __bench_cluster_empty, NULL);
+  }
+  cycles = __bench_cycles_stop(start);
+  __bench_cluster_print("pi_cluster_worker_send", cycles, nb_iter);
+
+  pi_cluster_worker_stop(&worker);
+
+  pi_cluster_close(&cluster_dev);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+#include "bench/bench.h"
+#include "stdio.h"
+
+#if defined(ARCHI_HAS_CLUSTER) && defined(ARCHI_HAS_FC) && defined(MCHAN_VERSION)
+
+#define BENCH_DMA_MAX_BLOCKS     64
+#define BENCH_DMA_MAX_BLOCK_SIZE 256
+
+// Blocks are taken every 4 blocks from this area to get discontiguous
+// transfers, like rows selected by an index
+static char __bench_dma_ext[BENCH_DMA_MAX_BLOCKS * BENCH_DMA_MAX_BLOCK_SIZE * 4];
+static RT_L1_DATA char __bench_dma_loc[BENCH_DMA_MAX_BLOCKS * BENCH_DMA_MAX_BLOCK_SIZE];
+static RT_L1_DATA pi_cl_dma_sg_entry_t __bench_dma_entries[BENCH_DMA_MAX_BLOCKS];
+
+typedef struct
+{
+  int nb_blocks;
+  int block_size;
+  unsigned int loop_cycles;
+  unsigned int sg_cycles;
+} bench_dma_t;
+
+static void __bench_dma_gather(void *arg)
+{
+  bench_dma_t *bench = (bench_dma_t *)arg;
+  int size = bench->block_size;
+  pi_cl_dma_cmd_t cmd;
+  pi_cl_dma_copy_t copy;
+  unsigned int start;
+
+  pi_perf_conf(1<<PI_PERF_CYCLES);
+  pi_perf_reset();
+  pi_perf_start();
+
+  // Reference: one command per block, all merged on the same counter so
+  // that they are all pushed before waiting once, as with the list
+  start = pi_perf_read(PI_PERF_CYCLES);
+  copy.dir = PI_CL_DMA_DIR_EXT2LOC;
+  copy.size = size;
+  for (int i=0; i<bench->nb_blocks; i++)
+  {
+    copy.ext = (uint32_t)&__bench_dma_ext[i*size*4];
+    copy.loc = (uint32_t)&__bench_dma_loc[i*size];
+    copy.merge = i != 0;
+    pi_cl_dma_memcpy(&copy);
+  }
+  pi_cl_dma_wait(&copy);
+  bench->loop_cycles = pi_perf_read(PI_PERF_CYCLES) - start;
+
+  // Same blocks gathered with one list, the list is built in the measure
+  // as a real user would have to
+  start = pi_perf_read(PI_PERF_CYCLES);
+  for (int i=0; i<bench->nb_blocks; i++)
+  {
+    __bench_dma_entries[i].ext = (uint32_t)&__bench_dma_ext[i*size*4];
+    __bench_dma_entries[i].loc = (uint32_t)&__bench_dma_loc[i*size];
+    __bench_dma_entries[i].size = size;
+    __bench_dma_entries[i].stride = 0;
+  }
+  pi_cl_dma_cmd_sg(__bench_dma_entries, bench->nb_blocks, PI_CL_DMA_DIR_EXT2LOC, &cmd);
+  pi_cl_dma_cmd_wait(&cmd);
+  bench->sg_cycles = pi_perf_read(PI_PERF_CYCLES) - start;
+
+  pi_perf_stop();
+}
+
+int bench_dma_gather(int cid, int nb_blocks, int block_size)
+{
+  struct pi_device cluster_dev;
+  struct pi_cluster_conf conf;
+  struct pi_cluster_task task;
+  bench_dma_t bench;
+
+  if (nb_blocks > BENCH_DMA_MAX_BLOCKS)
+    nb_blocks = BENCH_DMA_MAX_BLOCKS;
+
+  if (block_size > BENCH_DMA_MAX_BLOCK_SIZE)
+    block_size = BENCH_DMA_MAX_BLOCK_SIZE;
+
+  bench.nb_blocks = nb_blocks;
+  bench.block_size = block_size;
+
+  pi_cluster_conf_init(&conf);
+  conf.id = cid;
+  pi_open_from_conf(&cluster_dev, &conf);
+  if (pi_cluster_open(&cluster_dev))
+    return -1;
+
+  // Executed twice so that the second run is done with a warm icache
+  for (int i=0; i<2; i++)
+  {
+    pi_cluster_task(&task, __bench_dma_gather, &bench);
+    task.nb_cores = 1;
+    pi_cluster_send_task_to_cl(&cluster_dev, &task);
+  }
+
+  pi_cluster_close(&cluster_dev);
+
+  printf("DMA gather of %d blocks of %d bytes\n", nb_blocks, block_size);
+  printf("  one command per block: %d cycles\n", bench.loop_cycles);
+  printf("  scatter-gather list:   %d cycles\n", bench.sg_cycles);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+#include "bench/bench.h"
+#include "stdio.h"
+
+#define BENCH_MEMCPY_MAX_SIZE 40
+#define BENCH_MEMCPY_GUARD    8
+#define BENCH_MEMCPY_BUF_SIZE (BENCH_MEMCPY_MAX_SIZE + BENCH_MEMCPY_GUARD*2)
+
+static uint8_t __bench_memcpy_src[BENCH_MEMCPY_BUF_SIZE] __attribute__((aligned(4)));
+static uint8_t __bench_memcpy_dst[BENCH_MEMCPY_BUF_SIZE] __attribute__((aligned(4)));
+
+// Checks one copy, including the bytes around the destination which must
+// not be modified
+static int __bench_memcpy_check_one(int dst_offset, int src_offset, int size, int async)
+{
+  uint8_t *dst = &__bench_memcpy_dst[BENCH_MEMCPY_GUARD + dst_offset];
+  uint8_t *src = &__bench_memcpy_src[BENCH_MEMCPY_GUARD + src_offset];
+
+  for (int i=0; i<BENCH_MEMCPY_BUF_SIZE; i++)
+  {
+    __bench_memcpy_src[i] = i + 1;
+    __bench_memcpy_dst[i] = 0xA5;
+  }
+
+  if (async)
+  {
+    pi_task_t task;
+    pi_fc_memcpy_async(dst, src, size, pi_task_block(&task));
+    pi_task_wait_on(&task);
+  }
+  else
+  {
+    __rt_memcpy_fast(dst, src, size);
+  }
+
+  for (int i=0; i<BENCH_MEMCPY_BUF_SIZE; i++)
+  {
+    int pos = i - BENCH_MEMCPY_GUARD - dst_offset;
+    uint8_t expected = pos >= 0 && pos < size ? src[pos] : 0xA5;
+
+    if (__bench_memcpy_dst[i] != expected)
+    {
+      printf("Copy error (dst offset: %d, src offset: %d, size: %d, async: %d, index: %d, value: 0x%x, expected: 0x%x)\n",
+        dst_offset, src_offset, size, async, i, __bench_memcpy_dst[i], expected);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int bench_fc_memcpy_check(void)
+{
+  int errors = 0;
+
+  // Zero-size copies with an odd destination and a source misaligned by 2
+  // bytes take the half-word path, which must not copy anything
+  errors += __bench_memcpy_check_one(1, 3, 0, 0);
+  errors += __bench_memcpy_check_one(3, 1, 0, 1);
+
+  for (int size=0; size<=BENCH_MEMCPY_MAX_SIZE - 4; size++)
+  {
+    for (int dst_offset=0; dst_offset<4; dst_offset++)
+    {
+      for (int src_offset=0; src_offset<4; src_offset++)
+      {
+        errors += __bench_memcpy_check_one(dst_offset, src_offset, size, 0);
+        errors += __bench_memcpy_check_one(dst_offset, src_offset, size, 1);
+      }
+    }
+  }
+
+  printf("FC memcpy check: %d errors\n", errors);
+
+  return errors;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+#include "bench/bench.h"
+#include "stdio.h"
+
+#if defined(ARCHI_UDMA_HAS_SPIM)
+
+#define BENCH_SPI_TOTAL_SIZE (1024*1024)
+#define BENCH_SPI_REF_ITER   1024
+
+typedef struct
+{
+  struct pi_device *device;
+  void *buffer;
+  int size;
+  int remaining;
+  volatile int done;
+  pi_task_t task;
+} bench_spi_t;
+
+// Unit of work done by the fabric controller while the reads are running.
+// Pending events are executed at each iteration so that the next read is
+// started as soon as the previous one is over.
+static inline void __bench_spi_work()
+{
+  for (int i=0; i<16; i++)
+  {
+    __asm__ __volatile__ ("nop");
+  }
+  rt_event_execute(NULL, 0);
+}
+
+static void __bench_spi_next(void *arg)
+{
+  bench_spi_t *bench = (bench_spi_t *)arg;
+
+  if (bench->remaining == 0)
+  {
+    bench->done = 1;
+    return;
+  }
+
+  bench->remaining -= bench->size;
+  pi_task_callback(&bench->task, __bench_spi_next, bench);
+  pi_spi_receive_async(bench->device, bench->buffer, bench->size*8, PI_SPI_CS_AUTO, &bench->task);
+}
+
+int bench_spi_read(int itf, int cs, int baudrate, int buffer_size)
+{
+  struct pi_device device;
+  struct pi_spi_conf conf;
+  bench_spi_t bench;
+  unsigned int start, ref_cycles, cycles;
+  int iter = 0;
+
+  if (buffer_size > BENCH_SPI_TOTAL_SIZE)
+    buffer_size = BENCH_SPI_TOTAL_SIZE;
+
+  pi_spi_conf_init(&conf);
+  conf.itf = itf;
+  conf.cs = cs;
+  conf.max_baudrate = baudrate;
+  conf.wordsize = PI_SPI_WORDSIZE_32;
+  pi_open_from_conf(&device, &conf);
+  if (pi_spi_open(&device))
+    return -1;
+
+  bench.buffer = pi_l2_malloc(buffer_size);
+  if (bench.buffer == NULL)
+    goto error;
+
+  bench.device = &device;
+  bench.size = buffer_size;
+  bench.remaining = BENCH_SPI_TOTAL_SIZE / buffer_size * buffer_size;
+  bench.done = 0;
+
+  pi_perf_conf(1<<PI_PERF_CYCLES);
+  pi_perf_reset();
+  pi_perf_start();
+
+  // Reference: cost of the unit of work when nothing else is running
+  start = pi_perf_read(PI_PERF_CYCLES);
+  for (int i=0; i<BENCH_SPI_REF_ITER; i++)
+  {
+    __bench_spi_work();
+  }
+  ref_cycles = pi_perf_read(PI_PERF_CYCLES) - start;
+
+  // Same work done while the reads are running, the fabric controller is
+  // available for the time it spends in it
+  start = pi_perf_read(PI_PERF_CYCLES);
+  __bench_spi_next(&bench);
+  while (!bench.done)
+  {
+    __bench_spi_work();
+    iter++;
+  }
+  cycles = pi_perf_read(PI_PERF_CYCLES) - start;
+
+  pi_perf_stop();
+
+  pi_l2_free(bench.buffer, buffer_size);
+  pi_spi_close(&device);
+
+  unsigned int available = (unsigned int)(((unsigned long long)iter * ref_cycles * 100) / BENCH_SPI_REF_ITER / cycles);
+
+  printf("SPI read of %d bytes with %d bytes per read\n", BENCH_SPI_TOTAL_SIZE, buffer_size);
+  printf("  %d cycles, fabric controller available %d%% of the time\n", cycles, available);
+
+  return 0;
+
+error:
+  pi_spi_close(&device);
+  return -1;
+}
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 ETH Zurich, University of Bologna and GreenWaves Technologies
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmsis.h"
+#include "rt/rt_api.h"
+#include "bench/bench.h"
+#include "stdio.h"
+
+#if defined(ARCHI_HAS_CLUSTER) && defined(ARCHI_HAS_FC)
+
+#define BENCH_TASK_MAX_TASKS 64
+
+static rt_task_t __bench_tasks[BENCH_TASK_MAX_TASKS];
+static rt_task_t __bench_task_root;
+static int __bench_task_nb_tasks;
+static volatile int __bench_task_work[ARCHI_CLUSTER_NB_PE];
+
+static void __bench_task_entry(rt_task_t *task, int id)
+{
+  int work = task->args[0];
+
+  for (int i=0; i<work; i++)
+  {
+    __asm__ __volatile__ ("nop");
+  }
+
+  __bench_task_work[rt_core_id()] += work;
+}
+
+// Executed on one cluster core, which is the only one pushing tasks. They
+// are pushed to its own deque by batches fitting in it, and are stolen by
+// the other cores.
+static void __bench_task_root_entry(rt_task_t *task, int id)
+{
+  for (int first=0; first<__bench_task_nb_tasks; first+=RT_TASK_DEQUE_SIZE)
+  {
+    int last = first + RT_TASK_DEQUE_SIZE;
+    if (last > __bench_task_nb_tasks)
+      last = __bench_task_nb_tasks;
+
+    for (int i=first; i<last; i++)
+    {
+      rt_task_cl_push(&__bench_tasks[i]);
+    }
+
+    for (int i=first; i<last; i++)
+    {
+      rt_task_cl_wait(&__bench_tasks[i]);
+    }
+  }
+}
+
+// Tasks form a binary tree and each one first pushes its children from the
+// core executing it, so that the pushes are spread over all the deques. As
+// the owner of a deque pops the last task it pushed, a deque holds at most
+// one task per tree level plus the 2 last pushed, which fits in a deque for
+// BENCH_TASK_MAX_TASKS tasks.
+static void __bench_task_spawn_entry(rt_task_t *task, int id)
+{
+  int index = task - __bench_tasks;
+
+  for (int i=index*2+1; i<=index*2+2 && i<__bench_task_nb_tasks; i++)
+  {
+    rt_task_cl_push(&__bench_tasks[i]);
+  }
+
+  __bench_task_entry(task, id);
+}
+
+static void __bench_task_spawn_root_entry(rt_task_t *task, int id)
+{
+  rt_task_cl_push(&__bench_tasks[0]);
+
+  for (int i=0; i<__bench_task_nb_tasks; i++)
+  {
+    rt_task_cl_wait(&__bench_tasks[i]);
+  }
+}
+
+static void __bench_task_init(int nb_tasks, void (*entry)(rt_task_t *task, int id))
+{
+  unsigned int seed = 0x12345;
+
+  // Irregular task set, the amount of work per task varies between 1x and 32x
+  for (int i=0; i<nb_tasks; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    rt_task_init(&__bench_tasks[i], entry);
+    __bench_tasks[i].args[0] = 64 * (((seed >> 16) & 0x1f) + 1);
+    // Tasks may be waited before being pushed
+    __bench_tasks[i].event = NULL;
+  }
+
+  for (int i=0; i<ARCHI_CLUSTER_NB_PE; i++)
+  {
+    __bench_task_work[i] = 0;
+  }
+}
+
+static void __bench_task_report(char *name, unsigned int cycles, int nb_cores)
+{
+  int min = -1, max = 0, total = 0;
+
+  for (int i=0; i<nb_cores; i++)
+  {
+    int work = __bench_task_work[i];
+    total += work;
+    if (work > max) max = work;
+    if (min == -1 || work < min) min = work;
+  }
+
+  printf("%s: %d cycles, work per core min %d max %d avg %d\n", name, cycles, min, max, total / nb_cores);
+}
+
+int bench_task_irregular(int cid, int nb_tasks)
+{
+  rt_task_cluster_t cluster;
+  rt_task_conf_t conf;
+  unsigned int start;
+
+  if (nb_tasks > BENCH_TASK_MAX_TASKS)
+    nb_tasks = BENCH_TASK_MAX_TASKS;
+
+  __bench_task_nb_tasks = nb_tasks;
+
+  rt_cluster_mount(1, cid, 0, NULL);
+
+  rt_task_conf_init(&conf);
+  conf.cid = cid;
+  if (rt_task_cluster_init(&cluster, &conf, NULL))
+    return -1;
+
+  if (rt_event_alloc(NULL, nb_tasks))
+  {
+    rt_task_cluster_deinit(&cluster, NULL);
+    return -1;
+  }
+
+  pi_perf_conf(1<<PI_PERF_CYCLES);
+
+  // Reference: all tasks go through the queue shared by all cores, as with
+  // the scheduler without deques
+  __bench_task_init(nb_tasks, __bench_task_entry);
+  pi_perf_reset();
+  pi_perf_start();
+  start = pi_perf_read(PI_PERF_CYCLES);
+  for (int i=0; i<nb_tasks; i++)
+  {
+    rt_task_fc_push(&cluster, &__bench_tasks[i], rt_event_get_blocking(NULL));
+  }
+  for (int i=0; i<nb_tasks; i++)
+  {
+    rt_event_wait(__bench_tasks[i].event);
+  }
+  __bench_task_report("shared queue", pi_perf_read(PI_PERF_CYCLES) - start, conf.nb_cores);
+
+  // All tasks are pushed by one core, the other ones can only steal them
+  // from its deque
+  __bench_task_init(nb_tasks, __bench_task_entry);
+  rt_task_init(&__bench_task_root, __bench_task_root_entry);
+  pi_perf_reset();
+  start = pi_perf_read(PI_PERF_CYCLES);
+  rt_task_fc_push(&cluster, &__bench_task_root, NULL);
+  __bench_task_report("single pusher", pi_perf_read(PI_PERF_CYCLES) - start, conf.nb_cores);
+
+  // Same task set pushed by the cores executing the tasks, to their own
+  // deques
+  __bench_task_init(nb_tasks, __bench_task_spawn_entry);
+  rt_task_init(&__bench_task_root, __bench_task_spawn_root_entry);
+  pi_perf_reset();
+  start = pi_perf_read(PI_PERF_CYCLES);
+  rt_task_fc_push(&cluster, &__bench_task_root, NULL);
+  __bench_task_report("spread pushes", pi_perf_read(PI_PERF_CYCLES) - start, conf.nb_cores);
+  pi_perf_stop();
+
+  rt_event_free(NULL, nb_tasks);
+
+  rt_task_cluster_deinit(&cluster, NULL);
+
+  rt_cluster_mount(0, cid, 0, NULL);
+
+  return 0;
+}
+
+#endif
@@ -12,7 +12,7 @@ PULP_LIBS += rtio
 endif
 
 ifeq '$(CONFIG_LIB_BENCH_ENABLED)' '1'
-PULP_LIB_FC_SRCS_bench   += libs/bench/bench.c
+PULP_LIB_FC_SRCS_bench   += libs/bench/bench.c libs/bench/bench_cluster.c libs/bench/bench_task.c libs/bench/bench_dma.c libs/bench/bench_spi.c libs/bench/bench_memcpy.c
 PULP_LIBS += bench
 endif
 
@@ -45,7 +45,7 @@ PULP_SRCS += libs/io/io.c libs/io/fprintf.c libs/io/prf.c libs/io/sprintf.c
 # HYPER
 ifneq '$(udma/hyper/version)' ''
 PULP_CFLAGS += -D__RT_HYPER_COPY_ASM=1
-PULP_SRCS += drivers/hyper/hyperram-v$(udma/hyper/version).c
+PULP_SRCS += drivers/hyper/hyperram-v$(udma/hyper/version).c drivers/hyper/hyper_cache.c kernel/memcpy.c
 PULP_ASM_SRCS += drivers/hyper/hyperram-v$(udma/hyper/version)_asm.S
 endif
 